@@ -15,6 +15,19 @@ var image_texture: texture_2d<f32>;
 @group(0) @binding(2)
 var image_sampler: sampler;
 
+// Grass, foliage and dry foliage color of every biome
+@group(0) @binding(3)
+var<uniform> tints: array<vec4<f32>, 384>;
+
+// See PackedQuad in chunk.h for the layout of a quad
+struct SectionQuads {
+  origin: vec4<i32>,
+  quads: array<vec4<u32>>,
+};
+
+@group(1) @binding(0)
+var<storage, read> section_quads: SectionQuads;
+
 struct Vertex {
   @location(0) position: vec3<f32>,
   @location(1) color: vec4<f32>,
@@ -56,33 +69,101 @@ fn vs_main(vertex: Vertex) -> VertexOutput {
   return out;
 }
 
+// Draws one quad per instance, the index buffer walks the corners 0, 1, 2, 2, 3, 0
+@vertex
+fn vs_section(@builtin(vertex_index) vertex_index: u32, @builtin(instance_index) instance_index: u32) -> VertexOutput {
+  var out: VertexOutput;
+  let q = section_quads.quads[instance_index];
+  // How far along the first and second edge this corner is
+  let corner = vec2<f32>(f32(vertex_index == 1u || vertex_index == 2u), f32(vertex_index >= 2u));
+
+  let normal = i32(extractBits(q.x, 27u, 3u)) - 3;
+  let axis = u32(abs(normal)) - 1u;
+  var a = (axis + 1u) % 3u;
+  var b = (axis + 2u) % 3u;
+  if (extractBits(q.x, 30u, 1u) == 1u) {
+    let t = a;
+    a = b;
+    b = t;
+  }
+  var position = vec3<f32>(f32(extractBits(q.x, 0u, 9u)), f32(extractBits(q.x, 9u, 9u)), f32(extractBits(q.x, 18u, 9u))) / 16.0 - 8.0;
+  position[a] += corner.x * f32(extractBits(bitcast<i32>(q.y), 0u, 10u)) / 16.0;
+  position[b] += corner.y * f32(extractBits(bitcast<i32>(q.y), 10u, 10u)) / 16.0;
+  position += vec3<f32>(section_quads.origin.xyz);
+
+  let uv0 = vec2<f32>(f32(extractBits(q.z, 0u, 9u)), f32(extractBits(q.z, 9u, 9u))) / 16.0;
+  let uv2 = vec2<f32>(f32(extractBits(q.z, 18u, 9u)), f32(extractBits(q.w, 0u, 9u))) / 16.0;
+  var coord = mix(uv0, uv2, corner);
+  if (extractBits(q.x, 31u, 1u) == 1u) {
+    coord = mix(uv0, uv2, corner.yx);
+  }
+
+  let material = f32(extractBits(q.y, 20u, 12u));
+  let tint = extractBits(q.w, 13u, 2u);
+  let biome = extractBits(q.w, 15u, 7u);
+  out.color = vec4<f32>(1.0, 1.0, 1.0, 1.0);
+  if (tint != 0u) {
+    out.color = vec4<f32>(tints[biome * 3u + tint - 1u].rgb, 1.0);
+  }
+
+  var patchCount = vec2<f32>(TEXTURE_TILES, TEXTURE_TILES);
+  var patchIndex = vec2<f32>(material % patchCount.x, floor(material / patchCount.x));
+  var patchSize = vec2<f32>(1.0 / patchCount.x, 1.0 / patchCount.y);
+
+  out.position = uniforms.projection * uniforms.view * vec4<f32>(position, 1.0);
+  out.coord = coord;
+  out.patchCoord = patchSize * patchIndex;
+  out.patchOverlayCoord = vec2<f32>(0.0, 0.0);
+  out.sky_light = f32(extractBits(q.z, 27u, 4u)) / 15.0;
+  out.block_light = f32(extractBits(q.w, 9u, 4u)) / 15.0;
+  out.normal = f32(normal);
+  return out;
+}
+
 fn srgb_to_linear(in: vec4<f32>) -> vec4<f32> {
   return vec4<f32>(pow(in.rgb, vec3<f32>(2.2)), in.a);
 }
 
-@fragment
-fn fs_main(vertex: VertexOutput) -> @location(0) vec4<f32> {
+fn shade(vertex: VertexOutput, texture_color: vec4<f32>) -> vec4<f32> {
+  var color = texture_color;
   var patchCount = vec2<f32>(TEXTURE_TILES, TEXTURE_TILES);
   var patchSize = vec2(1.0 / patchCount.x, 1.0 / patchCount.y);
-  var texCoord = vertex.patchCoord + fract(vertex.coord) * patchSize;
-  var color = textureSample(image_texture, image_sampler, texCoord);
   var tint = srgb_to_linear(vertex.color);
   if (vertex.patchOverlayCoord.x == 0.0f && vertex.patchOverlayCoord.y == 0.0f) {
     color *= tint;
   }
   var overlayColor = textureSample(image_texture, image_sampler, vertex.patchOverlayCoord + fract(vertex.coord) * patchSize) * tint;
   color = mix(color, overlayColor, overlayColor.a);
-  if (color.a == 0.0f) {
-    discard;
-  }
   // -z, -y, -x, 0, +x, +y, +z
   var normal_multipliers: array<f32, 7> = array<f32, 7>(0.5, 0.3, 0.3, 0.0, 0.3, 0.7, 0.5);
 
   var internal_sky_light = uniforms.internal_sky_max - (1.0 - vertex.sky_light);
-  color = vec4<f32>(color.rgb * normal_multipliers[u32(vertex.normal + 3.0f)] * clamp(pow(clamp(internal_sky_light, 0.0, 1.0), 3.0) + 0.1, 0.0, 1.0), color.a);
+  return vec4<f32>(color.rgb * normal_multipliers[u32(vertex.normal + 3.0f)] * clamp(pow(clamp(internal_sky_light, 0.0, 1.0), 3.0) + 0.1, 0.0, 1.0), color.a);
+}
+
+fn sample_block(vertex: VertexOutput) -> vec4<f32> {
+  var patchCount = vec2<f32>(TEXTURE_TILES, TEXTURE_TILES);
+  var patchSize = vec2(1.0 / patchCount.x, 1.0 / patchCount.y);
+  var texCoord = vertex.patchCoord + fract(vertex.coord) * patchSize;
+  return textureSample(image_texture, image_sampler, texCoord);
+}
+
+// Used for cutout and translucent quads
+@fragment
+fn fs_main(vertex: VertexOutput) -> @location(0) vec4<f32> {
+  var color = shade(vertex, sample_block(vertex));
+  if (color.a == 0.0f) {
+    discard;
+  }
   return color;
 }
 
+// Opaque quads never discard, so the depth test can run before the fragment shader
+@fragment
+fn fs_opaque(vertex: VertexOutput) -> @location(0) vec4<f32> {
+  return vec4<f32>(shade(vertex, sample_block(vertex)).rgb, 1.0);
+}
+
 @fragment
 fn fs_destroy_main(vertex: VertexOutput) -> @location(0) vec4<f32> {
   var patchCount = vec2<f32>(TEXTURE_TILES, TEXTURE_TILES);
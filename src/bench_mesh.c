@@ -0,0 +1,178 @@
+// Decodes captured chunk payloads and meshes them over and over, without a window or GPU device.
+// Run it from the directory holding data/. Takes capture files (see mcapi/capture.h) or single packets, id varint first.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chunk.h"
+#include "datatypes.h"
+#include "game.h"
+#include "logging.h"
+#include "mcapi/capture.h"
+#include "mcapi/internal.h"
+#include "mcapi/protocol.h"
+#include "models.h"
+#include "texture_sheet.h"
+#include "world.h"
+
+// Defined by MCAPI_HANDLER in mcapi/chunk.c
+mcapiPacket *create_chunk_and_light_data_packet(ReadableBuffer *p);
+void destroy_chunk_and_light_data_packet(mcapiPacket *packet);
+
+static double now_seconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool read_payload(const char *filename, Buffer *buf) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  *buf = create_buffer(len);
+  bool ok = fread(buf->ptr, 1, len, file) == (size_t)len;
+  fclose(file);
+  return ok;
+}
+
+// Decodes a chunk packet into the world, adding the time it took to decode_time
+static bool load_chunk_packet(World *world, Buffer packet, double *decode_time) {
+  ReadableBuffer p = {.buf = packet, .cursor = 0};
+  if (read_varint(&p) != PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT) {
+    return false;
+  }
+  double start = now_seconds();
+  mcapiChunkAndLightDataPacket *chunk_packet = (mcapiChunkAndLightDataPacket *)create_chunk_and_light_data_packet(&p);
+  world_load_chunk(world, chunk_packet);
+  *decode_time += now_seconds() - start;
+  destroy_chunk_and_light_data_packet((mcapiPacket *)chunk_packet);
+  return true;
+}
+
+// Loads every chunk received in play, returns how many there were
+static int load_capture(World *world, const char *filename, double *decode_time) {
+  mcapiReplay *replay = mcapi_replay_create(filename, 0);
+  if (replay == NULL) {
+    return 0;
+  }
+  int loaded = 0;
+  mcapiCaptureRecord record;
+  Buffer packet;
+  while (mcapi_replay_next(replay, &record, &packet)) {
+    if (record.state == MCAPI_STATE_PLAY && record.packet_id == PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT) {
+      loaded += load_chunk_packet(world, packet, decode_time);
+    }
+    destroy_buffer(packet);
+  }
+  mcapi_replay_destroy(replay);
+  return loaded;
+}
+
+static void bench_mesher(World *world, BlockInfo *block_info, ChunkMesher mesher, const char *name, int iterations) {
+  chunk_set_mesher(mesher);
+  SectionMesh mesh = section_mesh_create(MAX_QUADS_PER_SECTION);
+  long sections = 0;
+  long quads = 0;
+
+  double start = now_seconds();
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    for (int i = 0; i < world->chunk_slots_used; i++) {
+      Chunk *chunk = world->chunks[i];
+      if (chunk == NULL) {
+        continue;
+      }
+      // Missing neighbors are treated as air, like the edge of the loaded area
+      Chunk *x_chunk = world_chunk(world, chunk->x - 1, chunk->z);
+      Chunk *z_chunk = world_chunk(world, chunk->x, chunk->z - 1);
+      for (int s = 0; s < Y_SECTIONS; s++) {
+        ChunkSection *neighbors[3] = {
+          x_chunk ? &x_chunk->sections[s] : NULL,
+          s > 0 ? &chunk->sections[s - 1] : NULL,
+          z_chunk ? &z_chunk->sections[s] : NULL,
+        };
+        chunk_section_build_mesh(&chunk->sections[s], neighbors, block_info, &mesh);
+        sections++;
+        quads += mesh.num_quads;
+      }
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  printf(
+    "%-7s %10.0f sections/s %8.1f quads/section %8.1f ns/quad\n",
+    name,
+    sections / elapsed,
+    (double)quads / sections,
+    quads > 0 ? elapsed * 1e9 / quads : 0.0
+  );
+  section_mesh_destroy(&mesh);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 20;
+  int first_payload = 1;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    iterations = atoi(argv[2]);
+    first_payload = 3;
+  }
+  if (first_payload >= argc || iterations < 1) {
+    printf("Usage: %s [-n iterations] <capture or chunk packet>...\n", argv[0]);
+    return 1;
+  }
+
+  // The texture sheet is only filled so the block models get their texture ids and passes
+  BlockTextureSheet texture_sheet = {
+    .texture_size = TEXTURE_SIZE,
+    .height = TEXTURE_TILES,
+    .width = TEXTURE_TILES,
+    .current_id = 1,
+    .data = calloc(TEXTURE_SIZE * TEXTURE_TILES * TEXTURE_SIZE * TEXTURE_TILES * 4, 1),
+  };
+  BlockInfo *block_info = calloc(MAX_BLOCKS, sizeof(BlockInfo));
+  load_blocks(block_info, &texture_sheet);
+  chunk_build_block_flags(block_info, MAX_BLOCKS);
+  chunk_build_texture_passes(&texture_sheet);
+
+  static World world;
+  world.chunk_pool = chunk_pool_create(CHUNK_POOL_SLAB_CHUNKS, true);
+  int decoded = 0;
+  double decode_time = 0;
+  for (int i = first_payload; i < argc; i++) {
+    Buffer buf;
+    if (!read_payload(argv[i], &buf)) {
+      WARN("Couldn't read %s", argv[i]);
+      continue;
+    }
+    if (buf.len >= CAPTURE_MAGIC_LEN && memcmp(buf.ptr, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) == 0) {
+      decoded += load_capture(&world, argv[i], &decode_time);
+    } else if (load_chunk_packet(&world, buf, &decode_time)) {
+      decoded++;
+    } else {
+      WARN("%s is not a chunk packet or a capture", argv[i]);
+    }
+    destroy_buffer(buf);
+  }
+  if (decoded == 0) {
+    FATAL("No chunks to mesh");
+    return 1;
+  }
+
+  long block_bytes = 0;
+  for (int i = 0; i < world.chunk_slots_used; i++) {
+    for (int s = 0; world.chunks[i] != NULL && s < Y_SECTIONS; s++) {
+      block_bytes += sizeof(PalettedContainer) * 2 + paletted_memory(&world.chunks[i]->sections[s].blocks) + paletted_memory(&world.chunks[i]->sections[s].biomes);
+    }
+  }
+  printf("Decoded %d chunks, %.1f us/chunk\n", decoded, decode_time * 1e6 / decoded);
+  printf("Blocks and biomes take %.1f KB/chunk\n", block_bytes / 1024.0 / decoded);
+  chunk_pool_report(world.chunk_pool);
+  bench_mesher(&world, block_info, CHUNK_MESHER_GREEDY, "greedy", iterations);
+  bench_mesher(&world, block_info, CHUNK_MESHER_BINARY, "binary", iterations);
+  return 0;
+}
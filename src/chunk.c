@@ -2,31 +2,165 @@
 
 #include <stdbool.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
 
 #include "cglm/vec3.h"
-#include "framework.h"
 #include "logging.h"
 
-// Max quads per chunk section times 4 vertices per quad times floats per vertex
-static float quads[(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 3) * 4 * FLOATS_PER_VERTEX];
+// Scratch space for chunk_section_update_mesh and chunk_section_patch_mesh, which only run on the main thread
+static SectionMesh main_thread_mesh = {0};
+static SectionMesh main_thread_patch = {0};
+static QuadArena *quad_arena = NULL;
+// Read by the meshing workers, so it can be flipped while they run
+static _Atomic ChunkMesher current_mesher = CHUNK_MESHER_BINARY;
+// Indexed by block state, small enough to stay in cache while meshing
+static BlockFlags *block_flags = NULL;
+// The MeshPass of each texture id, textures that weren't sorted are opaque
+static uint8_t texture_pass[1 << 12] = {0};
+
+static void free_section_quads(ChunkSection *section) {
+  quad_arena_free(quad_arena, &section->quad_range);
+  section->quad_capacity = 0;
+  section->num_quads = 0;
+}
+
+static void release_section_buffers(ChunkSection *section) {
+  free_section_quads(section);
+  section->has_mesh = false;
+  section_mesh_destroy(&section->mesh);
+}
 
 void chunk_destroy_buffers(Chunk *chunk) {
   for (int j = 0; j < 24; j++) {
-    if (chunk->sections[j].num_quads != 0) {
-      if (chunk->sections[j].vertex_buffer != NULL) {
-        wgpuBufferRelease(chunk->sections[j].vertex_buffer);
-        chunk->sections[j].vertex_buffer = NULL;
-      }
-    }
+    release_section_buffers(&chunk->sections[j]);
+    chunk->sections[j].mesh_job = 0;
   }
 }
 
-void chunk_destroy(Chunk *chunk) {
+void chunk_release_storage(Chunk *chunk) {
   chunk_destroy_buffers(chunk);
+  for (int j = 0; j < Y_SECTIONS; j++) {
+    paletted_destroy(&chunk->sections[j].blocks);
+    paletted_destroy(&chunk->sections[j].biomes);
+  }
+}
+
+void chunk_destroy(Chunk *chunk) {
+  chunk_release_storage(chunk);
   free(chunk);
 }
 
-int face_material_between(int a, int b, BlockInfo *block_info) {
+// Adds (or removes when sign is -1) one block to the section summary
+static void count_block(ChunkSection *section, int state, int sign) {
+  if (state == 0) {
+    return;
+  }
+  section->non_air_count += sign;
+  if (!(block_flags[state] & BLOCK_FULL)) {
+    section->non_full_count += sign;
+  }
+  if (block_flags[state] & BLOCK_TRANSPARENT) {
+    section->transparent_count += sign;
+  }
+}
+
+void chunk_section_count_blocks(ChunkSection *section) {
+  section->non_air_count = 0;
+  section->non_full_count = 0;
+  section->transparent_count = 0;
+  int blocks[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+  paletted_unpack(&section->blocks, 0, CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE, blocks);
+  for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++) {
+    count_block(section, blocks[i], 1);
+  }
+}
+
+void chunk_unpack_light(const uint8_t *light, int start, int count, uint8_t *out) {
+  // Simple enough for the compiler to vectorize
+  const uint8_t *in = light + start / 2;
+  for (int i = 0; i < count / 2; i++) {
+    out[2 * i] = in[i] & 0xF;
+    out[2 * i + 1] = in[i] >> 4;
+  }
+}
+
+int chunk_section_get_block(ChunkSection *section, int index) {
+  return paletted_get(&section->blocks, index);
+}
+
+void chunk_section_set_block(ChunkSection *section, int index, int state) {
+  int old = paletted_get(&section->blocks, index);
+  if (old == state) {
+    return;
+  }
+  count_block(section, old, -1);
+  count_block(section, state, 1);
+  paletted_set(&section->blocks, index, state);
+}
+
+void chunk_section_copy(ChunkSection *dst, ChunkSection *src) {
+  memcpy(dst, src, sizeof(ChunkSection));
+  // The copy doesn't get the retained mesh, only the main thread uses it
+  dst->mesh = (SectionMesh){0};
+  dst->blocks = (PalettedContainer){0};
+  dst->biomes = (PalettedContainer){0};
+  paletted_copy(&dst->blocks, &src->blocks);
+  paletted_copy(&dst->biomes, &src->biomes);
+}
+
+void chunk_section_destroy_copy(ChunkSection *section) {
+  paletted_destroy(&section->blocks);
+  paletted_destroy(&section->biomes);
+}
+
+static bool section_no_full_blocks(ChunkSection *section) {
+  return section->non_full_count == section->non_air_count;
+}
+
+// Every block is an opaque full block
+static bool section_solid(ChunkSection *section) {
+  return section->non_air_count == CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE && section->non_full_count == 0 && section->transparent_count == 0;
+}
+
+// The slice between a section and its neighbor below along some axis has no full block faces
+static bool section_boundary_hidden(ChunkSection *section, ChunkSection *below) {
+  if (below == NULL) {
+    return section_no_full_blocks(section);
+  }
+  return (section_no_full_blocks(section) && section_no_full_blocks(below)) || (section_solid(section) && section_solid(below));
+}
+
+SectionMesh section_mesh_create(int capacity) {
+  return (SectionMesh){
+    .quads = malloc((size_t)capacity * sizeof(PackedQuad)),
+    .num_quads = 0,
+    .capacity = capacity,
+  };
+}
+
+void section_mesh_destroy(SectionMesh *mesh) {
+  free(mesh->quads);
+  free(mesh->spare);
+  mesh->quads = NULL;
+  mesh->spare = NULL;
+  mesh->num_quads = 0;
+  mesh->capacity = 0;
+}
+
+void section_mesh_copy(SectionMesh *dst, SectionMesh *src) {
+  if (dst->capacity < src->num_quads) {
+    section_mesh_destroy(dst);
+    *dst = section_mesh_create(src->num_quads);
+  }
+  if (src->num_quads > 0) {
+    memcpy(dst->quads, src->quads, src->num_quads * sizeof(PackedQuad));
+  }
+  memcpy(dst->groups, src->groups, sizeof(src->groups));
+  dst->num_quads = src->num_quads;
+}
+
+int face_material_between(int a, int b) {
   if (a == 0 && b == 0) {
     return 0;
   }
@@ -37,11 +171,10 @@ int face_material_between(int a, int b, BlockInfo *block_info) {
     return a;
   }
   // At this point, neither a or b are air
-  // TODO: Need to lookup block transparency
-  bool a_full = block_info[abs(a)].fullblock;
-  bool b_full = block_info[abs(b)].fullblock;
-  bool ta = block_info[abs(a)].transparent || !a_full;
-  bool tb = block_info[abs(b)].transparent || !b_full;
+  BlockFlags a_flags = block_flags[abs(a)];
+  BlockFlags b_flags = block_flags[abs(b)];
+  bool ta = !(a_flags & BLOCK_OPAQUE);
+  bool tb = !(b_flags & BLOCK_OPAQUE);
   if (!ta && !tb) {
     return 0;
   }
@@ -52,7 +185,7 @@ int face_material_between(int a, int b, BlockInfo *block_info) {
     return a;
   }
   // Give preference to a full block
-  if (a_full) {
+  if (a_flags & BLOCK_FULL) {
     return a;
   }
   return -b;
@@ -68,108 +201,105 @@ bool mask_equal(MaskInfo a, MaskInfo b) {
   return a.material == b.material && a.sky_light == b.sky_light && a.block_light == b.block_light;
 }
 
-#define VEC4_EX(vec4) { vec4[0], vec4[1], vec4[2], vec4[3] }
-void quad(ChunkSection *section, uint16_t material, vec4 color, int sky_light, int block_light, int normal, vec3 pos[4], vec2 uv[4]) {
-  ChunkVertex* qs = (ChunkVertex*)quads;
-  int s = section->num_quads * 4;
-  ChunkVertex template = {
-    .position = {0.0f, 0.0f, 0.0f},
-    .coord = {0.0f, 0.0f},
-
-    .color = VEC4_EX(color),
-    .sky_light = sky_light,
-    .block_light = block_light,
-    .normal = normal,
-    .material = material,
-    .overlay_material = 0,
-  };
+static TintType block_tint(BlockInfo *info) {
+  if (info->grass) {
+    return TINT_GRASS;
+  } else if (info->foliage) {
+    return TINT_FOLIAGE;
+  } else if (info->dry_foliage) {
+    return TINT_DRY_FOLIAGE;
+  }
+  return TINT_NONE;
+}
+
+static uint32_t pack_bits(int value, int bits, int shift) {
+  return ((uint32_t)value & ((1u << bits) - 1)) << shift;
+}
+
+static int clamp_int(int value, int min, int max) {
+  return value < min ? min : value > max ? max : value;
+}
 
-  for (int i = 0; i < 4; i++) {
-    qs[s + i] = template;
-    glm_vec3_copy(pos[i], qs[s + i].position);
-    glm_vec2_copy(uv[i], qs[s + i].coord);
-  }
-
-  section->num_quads++;
-}
-
-void draw_quad(ChunkSection *section, vec3 base, vec3 x, vec3 du, vec3 dv, vec4 color, vec2 uv_base, vec2 uv_du, vec2 uv_dv, uint16_t texture, float sky_light, float block_light, int normal, bool swap_corners) {
-  int overlay_tile = 0;
-  int q = section->num_quads * 4 * FLOATS_PER_VERTEX;
-  quads[q + 0] = base[0] + x[0] + (swap_corners ? du[0] + dv[0] : 0);
-  quads[q + 1] = base[1] + x[1] + (swap_corners ? du[1] + dv[1] : 0);
-  quads[q + 2] = base[2] + x[2] + (swap_corners ? du[2] + dv[2] : 0);
-  quads[q + 3] = color[0];
-  quads[q + 4] = color[1];
-  quads[q + 5] = color[2];
-  quads[q + 6] = color[3];
-  quads[q + 7] = uv_base[0] + (swap_corners ? uv_du[0] + uv_dv[0] : 0);
-  quads[q + 8] = uv_base[1] + (swap_corners ? uv_du[1] + uv_dv[1] : 0);
-  quads[q + 9] = texture;
-  quads[q + 10] = overlay_tile;
-  quads[q + 11] = sky_light;
-  quads[q + 12] = block_light;
-  quads[q + 13] = normal;
-  q += FLOATS_PER_VERTEX;
-  quads[q + 0] = base[0] + x[0] + du[0];
-  quads[q + 1] = base[1] + x[1] + du[1];
-  quads[q + 2] = base[2] + x[2] + du[2];
-  quads[q + 3] = color[0];
-  quads[q + 4] = color[1];
-  quads[q + 5] = color[2];
-  quads[q + 6] = color[3];
-  quads[q + 7] = uv_base[0] + uv_du[0];
-  quads[q + 8] = uv_base[1] + uv_du[1];
-  quads[q + 9] = texture;
-  quads[q + 10] = overlay_tile;
-  quads[q + 11] = sky_light;
-  quads[q + 12] = block_light;
-  quads[q + 13] = normal;
-  q += FLOATS_PER_VERTEX;
-  quads[q + 0] = base[0] + x[0] + (swap_corners ? 0 : du[0] + dv[0]);
-  quads[q + 1] = base[1] + x[1] + (swap_corners ? 0 : du[1] + dv[1]);
-  quads[q + 2] = base[2] + x[2] + (swap_corners ? 0 : du[2] + dv[2]);
-  quads[q + 3] = color[0];
-  quads[q + 4] = color[1];
-  quads[q + 5] = color[2];
-  quads[q + 6] = color[3];
-  quads[q + 7] = uv_base[0] + (swap_corners ? 0 : uv_du[0] + uv_dv[0]);
-  quads[q + 8] = uv_base[1] + (swap_corners ? 0 : uv_du[1] + uv_dv[1]);
-  quads[q + 9] = texture;
-  quads[q + 10] = overlay_tile;
-  quads[q + 11] = sky_light;
-  quads[q + 12] = block_light;
-  quads[q + 13] = normal;
-  q += FLOATS_PER_VERTEX;
-  quads[q + 0] = base[0] + x[0] + dv[0];
-  quads[q + 1] = base[1] + x[1] + dv[1];
-  quads[q + 2] = base[2] + x[2] + dv[2];
-  quads[q + 3] = color[0];
-  quads[q + 4] = color[1];
-  quads[q + 5] = color[2];
-  quads[q + 6] = color[3];
-  quads[q + 7] = uv_base[0] + uv_dv[0];
-  quads[q + 8] = uv_base[1] + uv_dv[1];
-  quads[q + 9] = texture;
-  quads[q + 10] = overlay_tile;
-  quads[q + 11] = sky_light;
-  quads[q + 12] = block_light;
-  quads[q + 13] = normal;
-  q += FLOATS_PER_VERTEX;
-  section->num_quads += 1;
-}
-
-void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *block_info, BiomeInfo *biome_info, int sky_light, int block_light) {
-  vec4 block_color = {1.0f, 1.0f, 1.0f, 1.0f};
-  vec4 no_color = {1.0f, 1.0f, 1.0f, 1.0f};
-  if (block_info->grass) {
-    glm_vec3_copy(biome_info->grass_color, block_color);
-  } else if (block_info->foliage) {
-    glm_vec3_copy(biome_info->foliage_color, block_color);
-  } else if (block_info->dry_foliage) {
-    glm_vec3_copy(biome_info->dry_foliage_color, block_color);
+// Packs an axis aligned quad given by its corners in draw order, relative to the section, and the texture coordinate of each corner
+void quad(SectionMesh *mesh, uint16_t material, TintType tint, int biome, int sky_light, int block_light, int normal, vec3 pos[4], vec2 uv[4]) {
+  if (mesh->num_quads >= mesh->capacity) {
+    return;
   }
 
+  // The two edges leaving corner 0 lie along the axes of the face's plane, in either order
+  int d = abs(normal) - 1;
+  int a = (d + 1) % 3;
+  int b = (d + 2) % 3;
+  vec3 edge1, edge2;
+  glm_vec3_sub(pos[1], pos[0], edge1);
+  glm_vec3_sub(pos[3], pos[0], edge2);
+  bool edge_axis = edge1[a] == 0.0f;
+  if (edge_axis) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  int length1 = roundf(edge1[a] * 16);
+  int length2 = roundf(edge2[b] * 16);
+  if (length1 == 0 || length2 == 0) {
+    return;
+  }
+
+  // Only corners 0 and 2 are stored, uv_axis says whether the first edge moves v instead of u
+  bool uv_axis = uv[1][0] == uv[0][0] && uv[3][1] == uv[0][1];
+  // The shader only uses the fractional part, so shift by whole tiles to keep the coordinates positive
+  int u_shift = 16 * (int)floorf(fminf(uv[0][0], uv[2][0]));
+  int v_shift = 16 * (int)floorf(fminf(uv[0][1], uv[2][1]));
+  int u0 = clamp_int(roundf(uv[0][0] * 16) - u_shift, 0, 511);
+  int v0 = clamp_int(roundf(uv[0][1] * 16) - v_shift, 0, 511);
+  int u2 = clamp_int(roundf(uv[2][0] * 16) - u_shift, 0, 511);
+  int v2 = clamp_int(roundf(uv[2][1] * 16) - v_shift, 0, 511);
+
+  PackedQuad *q = &mesh->quads[mesh->num_quads];
+  q->data[0] = pack_bits(clamp_int(roundf(pos[0][0] * 16) + 128, 0, 511), 9, 0)
+    | pack_bits(clamp_int(roundf(pos[0][1] * 16) + 128, 0, 511), 9, 9)
+    | pack_bits(clamp_int(roundf(pos[0][2] * 16) + 128, 0, 511), 9, 18)
+    | pack_bits(normal + 3, 3, 27)
+    | pack_bits(edge_axis, 1, 30)
+    | pack_bits(uv_axis, 1, 31);
+  q->data[1] = pack_bits(length1, 10, 0)
+    | pack_bits(length2, 10, 10)
+    | pack_bits(material, 12, 20);
+  q->data[2] = pack_bits(u0, 9, 0)
+    | pack_bits(v0, 9, 9)
+    | pack_bits(u2, 9, 18)
+    | pack_bits(sky_light, 4, 27);
+  q->data[3] = pack_bits(v2, 9, 0)
+    | pack_bits(block_light, 4, 9)
+    | pack_bits(tint, 2, 13)
+    | pack_bits(biome, 7, 15);
+  mesh->num_quads++;
+}
+
+void draw_quad(SectionMesh *mesh, vec3 x, vec3 du, vec3 dv, TintType tint, int biome, vec2 uv_base, vec2 uv_du, vec2 uv_dv, uint16_t texture, int sky_light, int block_light, int normal, bool swap_corners) {
+  // Swapping the corners starts at the opposite one, which flips the winding
+  vec3 pos[4];
+  vec2 uv[4];
+  glm_vec3_copy(x, pos[0]);
+  glm_vec2_copy(uv_base, uv[0]);
+  glm_vec3_add(x, du, pos[1]);
+  glm_vec2_add(uv_base, uv_du, uv[1]);
+  glm_vec3_add(pos[1], dv, pos[2]);
+  glm_vec2_add(uv[1], uv_dv, uv[2]);
+  glm_vec3_add(x, dv, pos[3]);
+  glm_vec2_add(uv_base, uv_dv, uv[3]);
+  if (swap_corners) {
+    glm_vec3_copy(pos[2], pos[0]);
+    glm_vec2_copy(uv[2], uv[0]);
+    glm_vec3_copy(x, pos[2]);
+    glm_vec2_copy(uv_base, uv[2]);
+  }
+  quad(mesh, texture, tint, biome, sky_light, block_light, normal, pos, uv);
+}
+
+void cubiod(SectionMesh *mesh, vec3 base, MeshCuboid element, BlockInfo *block_info, int biome, int sky_light, int block_light) {
+  TintType tint = block_tint(block_info);
+
   vec3 a0;
   glm_vec3_scale(element.from, 1.0/16.0, a0);
   vec3 a1;
@@ -205,7 +335,7 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.up.texture, element.up.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.up.texture, element.up.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
   // Bottom face
   if (element.down.texture != 0) {
@@ -229,7 +359,7 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.down.texture, element.down.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.down.texture, element.down.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
   // North face
   if (element.north.texture != 0) {
@@ -253,7 +383,7 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.north.texture, element.north.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.north.texture, element.north.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
   // South face
   if (element.south.texture != 0) {
@@ -277,7 +407,7 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.south.texture, element.south.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.south.texture, element.south.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
   // East face
   if (element.east.texture != 0) {
@@ -301,7 +431,7 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.east.texture, element.east.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.east.texture, element.east.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
   // West face
   if (element.west.texture != 0) {
@@ -325,11 +455,11 @@ void cubiod(ChunkSection *section, vec3 base, MeshCuboid element, BlockInfo *blo
     for (int i = 0; i < 4; i++) {
       glm_vec3_add(base, pos[i], pos[i]);
     }
-    quad(section, element.west.texture, element.west.tint_index != 0 ? block_color : no_color, sky_light, block_light, normal, pos, coord);
+    quad(mesh, element.west.texture, element.west.tint_index != 0 ? tint : TINT_NONE, biome, sky_light, block_light, normal, pos, coord);
   }
 }
 
-void draw_cubiod(ChunkSection *section, vec3 base, int bx, int by, int bz, MeshCuboid element, BlockInfo *block_info, BiomeInfo *biome_info) {
+void draw_cubiod(ChunkSection *section, SectionMesh *mesh, int bx, int by, int bz, MeshCuboid element, BlockInfo *block_info) {
   vec3 b = {bx, by, bz};
   vec3 from, to;
   glm_vec3_copy(element.from, from);
@@ -342,8 +472,8 @@ void draw_cubiod(ChunkSection *section, vec3 base, int bx, int by, int bz, MeshC
   glm_vec3_add(x_end, b, x_end);
   vec3 delta;
   glm_vec3_sub(x_end, x_start, delta);
-  float sky_light = 1.0;
-  float block_light = 1.0;
+  int sky_light = 15;
+  int block_light = 15;
 
   for (int d = 0; d < 3; d++) {
     for (int side = -1; side <= 1; side += 2) {
@@ -412,229 +542,656 @@ void draw_cubiod(ChunkSection *section, vec3 base, int bx, int by, int bz, MeshC
         uv_du[0] = -uv_du[0];
       }
 
-      vec4 color = {1.0f, 1.0f, 1.0f, 1.0f};
       ivec3 biome_x = {floor(x[0] / 4.0), floor(x[1] / 4.0), floor(x[2] / 4.0)};
-      int biome_index = section->biome_data[biome_x[0] + 4 * (biome_x[2] + 4 * biome_x[1])];
-      BiomeInfo biome = biome_info[biome_index];
-      if (face->tint_index == 1) {
-        if (block_info->grass) {
-          glm_vec3_copy(biome.grass_color, color);
-        } else if (block_info->foliage) {
-          glm_vec3_copy(biome.foliage_color, color);
-        } else if (block_info->dry_foliage) {
-          glm_vec3_copy(biome.dry_foliage_color, color);
-        }
-      }
+      int biome_index = paletted_get(&section->biomes, biome_x[0] + 4 * (biome_x[2] + 4 * biome_x[1]));
+      TintType tint = face->tint_index == 1 ? block_tint(block_info) : TINT_NONE;
 
       // WARN("uv_base %f %f", uv_base[0], uv_base[1]);
       // WARN("uv_du %f %f", uv_du[0], uv_du[1]);
       // WARN("uv_dv %f %f", uv_dv[0], uv_dv[1]);
-      draw_quad(section, base, x, du, dv, color, uv_base, uv_du, uv_dv, face->texture, sky_light, block_light, normal, swap_corners);
+      draw_quad(mesh, x, du, dv, tint, biome_index, uv_base, uv_du, uv_dv, face->texture, sky_light, block_light, normal, swap_corners);
     }
   }
 }
 
-void chunk_section_update_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device) {
-  section->num_quads = 0;
-  MaskInfo mask[16 * 16];
-  vec3 base = {section->x * CHUNK_SIZE, section->y * CHUNK_SIZE, section->z * CHUNK_SIZE};
+// The axes a slice perpendicular to d is walked along, u is merged first
+static void slice_axes(int d, int *u, int *v) {
+  *u = (d + 1) % 3;
+  *v = (d + 2) % 3;
+  if (d == 0) {
+    *u = (d + 2) % 3;
+    *v = (d + 1) % 3;
+  }
+}
 
-  // Create full blocks
-  for (int d = 0; d < 3; d += 1) {
-    int u = (d + 1) % 3;
-    int v = (d + 2) % 3;
-    int x[3] = {0, 0, 0};
+// Emits the quads for a w by h patch of full block faces in the slice x[d], starting at x
+static void full_block_face(SectionMesh *mesh, ChunkSection *section, int x[3], int d, int u, int v, int w, int h, MaskInfo m, BlockInfo *block_info) {
+  int du[3] = {0};
+  du[u] = w;
+  int dv[3] = {0};
+  dv[v] = h;
 
+  int state = abs(m.material) > 65535 ? 0 : abs(m.material); // Fails here!!!!
+  BlockFlags flags = block_flags[state];
+  if (!(flags & BLOCK_FULL) || !(flags & BLOCK_HAS_MODEL)) {
+    return;
+  }
+  BlockInfo *info = &block_info[state];
+
+  for (size_t el = 0; el < info->mesh.num_elements; el++) {
+    MeshFace face = {};
+    if (d == 1 && m.material > 0) {
+      face = info->mesh.elements[el].up;
+    } else if (d == 1 && m.material < 0) {
+      face = info->mesh.elements[el].down;
+    } else if (d == 0 && m.material > 0) {
+      face = info->mesh.elements[el].north;
+    } else if (d == 0 && m.material < 0) {
+      face = info->mesh.elements[el].south;
+    } else if (d == 2 && m.material > 0) {
+      face = info->mesh.elements[el].east;
+    } else if (d == 2 && m.material < 0) {
+      face = info->mesh.elements[el].west;
+    } else {
+      face = info->mesh.elements[el].up;
+    }
+
+    if (!face.texture) {
+      continue;
+    }
+
+    // The shader looks up the biome color
+    ivec3 biome_x = {floor(x[0] / 4.0), floor(x[1] / 4.0), floor(x[2] / 4.0)};
+    int biome_index = paletted_get(&section->biomes, biome_x[0] + 4 * (biome_x[2] + 4 * biome_x[1]));
+    TintType tint = face.tint_index == 1 ? BLOCK_TINT(flags) : TINT_NONE;
+
+    int normal = (m.material > 0 ? 1 : -1) * (d + 1);
+    vec4 uv = {0, 0, w, h};
+    vec2 uv_base = {uv[0], uv[1]};
+    vec2 uv_du = {uv[2] - uv[0], 0};
+    // Flip the texture coordinate y since texture origin is top left
+    vec2 uv_dv = {0, -(uv[3] - uv[1])};
+
+    vec3 vec_x = {x[0], x[1], x[2]};
+    vec3 vec_du = {du[0], du[1], du[2]};
+    vec3 vec_dv = {dv[0], dv[1], dv[2]};
+    bool swap_corners = false;
+    // Flip things when it's on the back face
+    if (m.material < 0) {
+      swap_corners = !swap_corners;
+      uv_du[0] = -uv_du[0];
+    }
+    // Also flip things when it's the x dimension
     if (d == 0) {
-      u = (d + 2) % 3;
-      v = (d + 1) % 3;
+      swap_corners = !swap_corners;
+      uv_du[0] = -uv_du[0];
+    }
+    draw_quad(mesh, vec_x, vec_du, vec_dv, tint, biome_index, uv_base, uv_du, uv_dv, face.texture, m.sky_light, m.block_light, normal, swap_corners);
+  }
+}
+
+// Builds a material mask for the slice x[d] == slice and greedily merges it
+static void mesh_slice_greedy(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, SectionMesh *mesh, int d, int slice) {
+  MaskInfo mask[16 * 16];
+  int u, v;
+  slice_axes(d, &u, &v);
+  int x[3] = {0, 0, 0};
+  x[d] = slice;
+
+  // Make a mask
+  for (x[u] = 0; x[u] < 16; x[u] += 1) {
+    for (x[v] = 0; x[v] < 16; x[v] += 1) {
+      int above_index = x[0] + CHUNK_SIZE * (x[2] + CHUNK_SIZE * x[1]);
+      int above = paletted_get(&section->blocks, above_index);
+      int above_sky_light = light_get(section->sky_light, above_index);
+      int above_block_light = light_get(section->block_light, above_index);
+      int xb[3] = {x[0], x[1], x[2]};
+      xb[d] -= 1;
+      int below;
+      int below_sky_light;
+      int below_block_light;
+      if (xb[d] < 0) {
+        if (neighbors[d] == NULL) {
+          below = 0;
+          below_sky_light = 15;
+          below_block_light = 15;
+        } else {
+          xb[d] = 15;
+          int below_index = xb[0] + CHUNK_SIZE * (xb[2] + CHUNK_SIZE * xb[1]);
+          below = paletted_get(&neighbors[d]->blocks, below_index);
+          below_sky_light = light_get(neighbors[d]->sky_light, below_index);
+          below_block_light = light_get(neighbors[d]->block_light, below_index);
+        }
+      } else {
+        int below_index = xb[0] + CHUNK_SIZE * (xb[2] + CHUNK_SIZE * xb[1]);
+        below = paletted_get(&section->blocks, below_index);
+        below_sky_light = light_get(section->sky_light, below_index);
+        below_block_light = light_get(section->block_light, below_index);
+      }
+      int material = face_material_between(below, above);
+      mask[x[v] + CHUNK_SIZE * x[u]].material = material;
+      mask[x[v] + CHUNK_SIZE * x[u]].sky_light = material < 0 ? below_sky_light : above_sky_light;
+      mask[x[v] + CHUNK_SIZE * x[u]].block_light = material < 0 ? below_block_light : above_block_light;
     }
+  }
 
+  // Greedily find a quad where the mask is the same value and repeat
+  for (int j = 0; j < CHUNK_SIZE; j += 1) {
+    for (int i = 0; i < CHUNK_SIZE;) {
+      MaskInfo m = mask[j + CHUNK_SIZE * i];
+      if (m.material == 0) {
+        i += 1;
+        continue;
+      }
+      int w = 1;
+      while (i + w < CHUNK_SIZE && mask_equal(mask[j + CHUNK_SIZE * (i + w)], m)) {
+        w += 1;
+      }
+      int h = 1;
+      bool done = false;
+      for (; j + h < CHUNK_SIZE; h += 1) {
+        for (int k = 0; k < w; k += 1) {
+          if (!mask_equal(mask[(j + h) + CHUNK_SIZE * (i + k)], m)) {
+            done = true;
+            break;
+          }
+        }
+        if (done) {
+          break;
+        }
+      }
+
+      // Add quad
+      x[u] = i;
+      x[v] = j;
+      full_block_face(mesh, section, x, d, u, v, w, h, m, block_info);
+      // Zero out mask
+      for (int l = 0; l < h; l += 1) {
+        for (int k = 0; k < w; k += 1) {
+          mask[(j + l) + CHUNK_SIZE * (i + k)].material = 0;
+        }
+      }
+    }
+  }
+}
+
+// Meshes the full blocks by building a material mask for every slice and greedily merging it
+static void mesh_full_blocks_greedy(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, SectionMesh *mesh) {
+  for (int d = 0; d < 3; d += 1) {
     // Go over all the slices in this dimension
-    for (x[d] = 0; x[d] < 16; x[d] += 1) {
-      // Make a mask
-      for (x[u] = 0; x[u] < 16; x[u] += 1) {
-        for (x[v] = 0; x[v] < 16; x[v] += 1) {
-          int above_index = x[0] + CHUNK_SIZE * (x[2] + CHUNK_SIZE * x[1]);
-          int above = section->data[above_index];
-          int above_sky_light = section->sky_light[above_index];
-          int above_block_light = section->block_light[above_index];
-          int xb[3] = {x[0], x[1], x[2]};
-          xb[d] -= 1;
-          int below;
-          int below_sky_light;
-          int below_block_light;
-          if (xb[d] < 0) {
-            if (neighbors[d] == NULL) {
-              below = 0;
-              below_sky_light = 15;
-              below_block_light = 15;
-            } else {
-              xb[d] = 15;
-              int below_index = xb[0] + CHUNK_SIZE * (xb[2] + CHUNK_SIZE * xb[1]);
-              below = neighbors[d]->data[below_index];
-              below_sky_light = neighbors[d]->sky_light[below_index];
-              below_block_light = neighbors[d]->block_light[below_index];
-            }
-          } else {
-            int below_index = xb[0] + CHUNK_SIZE * (xb[2] + CHUNK_SIZE * xb[1]);
-            below = section->data[below_index];
-            below_sky_light = section->sky_light[below_index];
-            below_block_light = section->block_light[below_index];
+    for (int slice = 0; slice < CHUNK_SIZE; slice += 1) {
+      mesh->groups[SLICE_GROUP(d, slice)] = mesh->num_quads;
+      mesh_slice_greedy(section, neighbors, block_info, mesh, d, slice);
+    }
+  }
+}
+
+// The mask entry the greedy mesher would see for a visible face at x, where below is the section holding x[d] - 1
+static MaskInfo face_mask_info(ChunkSection *section, ChunkSection *below_section, int x[3], int d, bool positive) {
+  int above_index = x[0] + CHUNK_SIZE * (x[2] + CHUNK_SIZE * x[1]);
+  int xb[3] = {x[0], x[1], x[2]};
+  xb[d] -= 1;
+  if (xb[d] < 0) {
+    xb[d] = 15;
+  }
+  int below_index = xb[0] + CHUNK_SIZE * (xb[2] + CHUNK_SIZE * xb[1]);
+  if (positive) {
+    // The face belongs to the block below and looks into the block above
+    return (MaskInfo){
+      .material = paletted_get(&below_section->blocks, below_index),
+      .sky_light = light_get(section->sky_light, above_index),
+      .block_light = light_get(section->block_light, above_index),
+    };
+  }
+  if (below_section == NULL) {
+    return (MaskInfo){.material = -paletted_get(&section->blocks, above_index), .sky_light = 15, .block_light = 15};
+  }
+  return (MaskInfo){
+    .material = -paletted_get(&section->blocks, above_index),
+    .sky_light = light_get(below_section->sky_light, below_index),
+    .block_light = light_get(below_section->block_light, below_index),
+  };
+}
+
+// Meshes the full blocks using one bitmask per column: bit 0 is the last cell of the neighbor below
+// and bit i + 1 is cell i. Visible faces fall out of a few shifts and ANDs, then each slice is merged
+// greedily on 16 bit rows, only looking at the blocks where a face actually is.
+static void mesh_full_blocks_binary(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, SectionMesh *mesh) {
+  int axis_u[3], axis_v[3];
+  for (int d = 0; d < 3; d++) {
+    slice_axes(d, &axis_u[d], &axis_v[d]);
+  }
+
+  // Columns along each axis, indexed by x[u] + CHUNK_SIZE * x[v]
+  uint32_t full[3][CHUNK_SIZE * CHUNK_SIZE] = {0};
+  uint32_t opaque[3][CHUNK_SIZE * CHUNK_SIZE] = {0};
+
+  int blocks[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+  paletted_unpack(&section->blocks, 0, CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE, blocks);
+  for (int y = 0; y < CHUNK_SIZE; y++) {
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+      for (int x = 0; x < CHUNK_SIZE; x++) {
+        BlockFlags flags = block_flags[blocks[x + CHUNK_SIZE * (z + CHUNK_SIZE * y)]];
+        if (!(flags & BLOCK_FULL)) {
+          continue;
+        }
+        bool is_opaque = flags & BLOCK_OPAQUE;
+        int p[3] = {x, y, z};
+        for (int d = 0; d < 3; d++) {
+          int c = p[axis_u[d]] + CHUNK_SIZE * p[axis_v[d]];
+          full[d][c] |= 1u << (p[d] + 1);
+          if (is_opaque) {
+            opaque[d][c] |= 1u << (p[d] + 1);
           }
-          int material = face_material_between(below, above, block_info);
-          mask[x[v] + CHUNK_SIZE * x[u]].material = material;
-          mask[x[v] + CHUNK_SIZE * x[u]].sky_light = material < 0 ? below_sky_light : above_sky_light;
-          mask[x[v] + CHUNK_SIZE * x[u]].block_light = material < 0 ? below_block_light : above_block_light;
         }
       }
+    }
+  }
+
+  for (int d = 0; d < 3; d++) {
+    int u = axis_u[d];
+    int v = axis_v[d];
 
-      // Greedily find a quad where the mask is the same value and repeat
-      for (int j = 0; j < CHUNK_SIZE; j += 1) {
-        for (int i = 0; i < CHUNK_SIZE;) {
-          MaskInfo m = mask[j + CHUNK_SIZE * i];
-          if (m.material == 0) {
-            i += 1;
+    if (neighbors[d] != NULL) {
+      int x[3];
+      x[d] = 15;
+      for (x[v] = 0; x[v] < CHUNK_SIZE; x[v]++) {
+        for (x[u] = 0; x[u] < CHUNK_SIZE; x[u]++) {
+          BlockFlags flags = block_flags[paletted_get(&neighbors[d]->blocks, x[0] + CHUNK_SIZE * (x[2] + CHUNK_SIZE * x[1]))];
+          if (!(flags & BLOCK_FULL)) {
             continue;
           }
-          int w = 1;
-          while (mask_equal(mask[j + CHUNK_SIZE * (i + w)], m) && i + w < 16) {
-            w += 1;
+          int c = x[u] + CHUNK_SIZE * x[v];
+          full[d][c] |= 1;
+          if (flags & BLOCK_OPAQUE) {
+            opaque[d][c] |= 1;
           }
-          int h = 1;
-          bool done = false;
-          for (; j + h < CHUNK_SIZE; h += 1) {
-            for (int k = 0; k < w; k += 1) {
-              if (!mask_equal(mask[(j + h) + CHUNK_SIZE * (i + k)], m)) {
-                done = true;
+        }
+      }
+    }
+
+    // Visible faces per slice, rows are indexed by x[v] and bits by x[u]
+    // [0] faces pointing towards +d owned by the block below, [1] faces pointing towards -d owned by the block above
+    uint16_t rows[2][CHUNK_SIZE][CHUNK_SIZE] = {0};
+    for (int c = 0; c < CHUNK_SIZE * CHUNK_SIZE; c++) {
+      uint32_t f = full[d][c];
+      uint32_t o = opaque[d][c];
+      // A full block shows its top unless an opaque block sits on it
+      uint32_t faces[2];
+      faces[0] = f & ~(o >> 1) & 0xFFFF;
+      // A full block shows its bottom when an opaque block sits on a non opaque one,
+      // or a transparent one sits on something that isn't full
+      faces[1] = (f >> 1) & (((o >> 1) & ~o) | (~(o >> 1) & ~f)) & 0xFFFF;
+
+      int xu = c % CHUNK_SIZE;
+      int xv = c / CHUNK_SIZE;
+      for (int side = 0; side < 2; side++) {
+        while (faces[side] != 0) {
+          int slice = __builtin_ctz(faces[side]);
+          rows[side][slice][xv] |= 1u << xu;
+          faces[side] &= faces[side] - 1;
+        }
+      }
+    }
+
+    int x[3] = {0, 0, 0};
+    for (x[d] = 0; x[d] < CHUNK_SIZE; x[d]++) {
+      mesh->groups[SLICE_GROUP(d, x[d])] = mesh->num_quads;
+      ChunkSection *below_section = x[d] == 0 ? neighbors[d] : section;
+      for (int side = 0; side < 2; side++) {
+        bool positive = side == 0;
+        uint16_t *row = rows[side][x[d]];
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+          while (row[j] != 0) {
+            int i = __builtin_ctz(row[j]);
+            x[u] = i;
+            x[v] = j;
+            MaskInfo m = face_mask_info(section, below_section, x, d, positive);
+
+            int w = 1;
+            for (; i + w < CHUNK_SIZE && (row[j] >> (i + w) & 1); w++) {
+              x[u] = i + w;
+              if (!mask_equal(face_mask_info(section, below_section, x, d, positive), m)) {
                 break;
               }
             }
-            if (done) {
-              break;
-            }
-          }
+            uint32_t run = ((1u << w) - 1) << i;
 
-          // Add quad
-          x[u] = i;
-          x[v] = j;
-          int du[3] = {0};
-          du[u] = w;
-          int dv[3] = {0};
-          dv[v] = h;
-
-          BlockInfo info = abs(m.material) > 65535 ? block_info[0] : block_info[abs(m.material)]; // Fails here!!!!
-
-          for (size_t el = 0; el < info.mesh.num_elements; el++) {
-            MeshFace face = {};
-            if (info.fullblock) {
-              if (d == 1 && m.material > 0) {
-                face = info.mesh.elements[el].up;
-              } else if (d == 1 && m.material < 0) {
-                face = info.mesh.elements[el].down;
-              } else if (d == 0 && m.material > 0) {
-                face = info.mesh.elements[el].north;
-              } else if (d == 0 && m.material < 0) {
-                face = info.mesh.elements[el].south;
-              } else if (d == 2 && m.material > 0) {
-                face = info.mesh.elements[el].east;
-              } else if (d == 2 && m.material < 0) {
-                face = info.mesh.elements[el].west;
-              } else {
-                face = info.mesh.elements[el].up;
+            int h = 1;
+            for (; j + h < CHUNK_SIZE && (row[j + h] & run) == run; h++) {
+              bool same = true;
+              x[v] = j + h;
+              for (int k = 0; k < w && same; k++) {
+                x[u] = i + k;
+                same = mask_equal(face_mask_info(section, below_section, x, d, positive), m);
               }
-            }
-
-            if (!face.texture) {
-              continue;
-            }
-
-            // Get the biome color
-            vec4 color = {1.0f, 1.0f, 1.0f, 1.0f};
-            ivec3 biome_x = {floor(x[0] / 4.0), floor(x[1] / 4.0), floor(x[2] / 4.0)};
-            int biome_index = section->biome_data[biome_x[0] + 4 * (biome_x[2] + 4 * biome_x[1])];
-            BiomeInfo biome = biome_info[biome_index];
-            if (face.tint_index == 1) {
-              if (info.grass) {
-                glm_vec3_copy(biome.grass_color, color);
-              } else if (info.foliage) {
-                glm_vec3_copy(biome.foliage_color, color);
-              } else if (info.dry_foliage) {
-                glm_vec3_copy(biome.dry_foliage_color, color);
+              if (!same) {
+                break;
               }
             }
 
-            int normal = (m.material > 0 ? 1 : -1) * (d + 1);
-            vec4 uv = {0, 0, w, h};
-            vec2 uv_base = {uv[0], uv[1]};
-            vec2 uv_du = {uv[2] - uv[0], 0};
-            // Flip the texture coordinate y since texture origin is top left
-            vec2 uv_dv = {0, -(uv[3] - uv[1])};
-
-            vec3 vec_x = {x[0], x[1], x[2]};
-            vec3 vec_du = {du[0], du[1], du[2]};
-            vec3 vec_dv = {dv[0], dv[1], dv[2]};
-            bool swap_corners = false;
-            // Flip things when it's on the back face
-            if (m.material < 0) {
-              swap_corners = !swap_corners;
-              uv_du[0] = -uv_du[0];
-            }
-            // Also flip things when it's the x dimension
-            if (d == 0) {
-              swap_corners = !swap_corners;
-              uv_du[0] = -uv_du[0];
-            }
-            draw_quad(section, base, vec_x, vec_du, vec_dv, color, uv_base, uv_du, uv_dv, face.texture, m.sky_light / 15.0f, m.block_light / 15.0f, normal, swap_corners);
-          }
-          // Zero out mask
-          for (int l = 0; l < h; l += 1) {
-            for (int k = 0; k < w; k += 1) {
-              mask[(j + l) + CHUNK_SIZE * (i + k)].material = 0;
+            for (int l = 0; l < h; l++) {
+              row[j + l] &= ~run;
             }
+            x[u] = i;
+            x[v] = j;
+            full_block_face(mesh, section, x, d, u, v, w, h, m, block_info);
           }
         }
       }
     }
   }
+}
 
-  // Create non-full blocks
+void chunk_set_mesher(ChunkMesher mesher) {
+  atomic_store(&current_mesher, mesher);
+}
+
+ChunkMesher chunk_get_mesher() {
+  return atomic_load(&current_mesher);
+}
+
+// Meshes the non-full blocks in the layer y, they don't depend on their neighbors
+static void mesh_layer_non_full(ChunkSection *section, BlockInfo *block_info, SectionMesh *mesh, int y) {
+  int layer[CHUNK_SIZE * CHUNK_SIZE];
+  paletted_unpack(&section->blocks, CHUNK_SIZE * CHUNK_SIZE * y, CHUNK_SIZE * CHUNK_SIZE, layer);
+  int biomes[4 * 4];
+  paletted_unpack(&section->biomes, 4 * 4 * (y / 4), 4 * 4, biomes);
+  uint8_t sky_light[CHUNK_SIZE * CHUNK_SIZE];
+  uint8_t block_light[CHUNK_SIZE * CHUNK_SIZE];
+  chunk_unpack_light(section->sky_light, CHUNK_SIZE * CHUNK_SIZE * y, CHUNK_SIZE * CHUNK_SIZE, sky_light);
+  chunk_unpack_light(section->block_light, CHUNK_SIZE * CHUNK_SIZE * y, CHUNK_SIZE * CHUNK_SIZE, block_light);
   for (int x = 0; x < CHUNK_SIZE; x++) {
-    for (int y = 0; y < CHUNK_SIZE; y++) {
-      for (int z = 0; z < CHUNK_SIZE; z++) {
-        int index = x + CHUNK_SIZE * (z + CHUNK_SIZE * y);
-        int state = section->data[index];
-        int sky_light = section->sky_light[index];
-        int block_light = section->block_light[index];
-        BlockInfo info = block_info[state];
-        ivec3 biome_x = {floor(x / 4.0), floor(y / 4.0), floor(z / 4.0)};
-        int biome_index = section->biome_data[biome_x[0] + 4 * (biome_x[2] + 4 * biome_x[1])];
-        vec3 block_base = {x, y, z};
-        glm_vec3_add(base, block_base, block_base);
-        BiomeInfo *block_biome_info = &biome_info[biome_index];
-
-        if (!info.fullblock) {
-          for (size_t el = 0; el < info.mesh.num_elements; el++) {
-            cubiod(section, block_base, info.mesh.elements[el], &info, block_biome_info, sky_light, block_light);
-            // draw_cubiod(section, base, x, y, z, info.mesh.elements[el], &info, biome_info);
-          }
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+      int index = x + CHUNK_SIZE * z;
+      int state = layer[index];
+      if ((block_flags[state] & (BLOCK_FULL | BLOCK_HAS_MODEL)) != BLOCK_HAS_MODEL) {
+        continue;
+      }
+      BlockInfo *info = &block_info[state];
+      int biome_index = biomes[x / 4 + 4 * (z / 4)];
+
+      // Move the baked quads to the block and add what varies per block
+      uint32_t offset = pack_bits(x * 16, 9, 0) | pack_bits(y * 16, 9, 9) | pack_bits(z * 16, 9, 18);
+      uint32_t sky = pack_bits(sky_light[index], 4, 27);
+      uint32_t light_and_biome = pack_bits(block_light[index], 4, 9) | pack_bits(biome_index, 7, 15);
+      int count = info->num_quads;
+      if (count > mesh->capacity - mesh->num_quads) {
+        count = mesh->capacity - mesh->num_quads;
+      }
+      PackedQuad *out = mesh->quads + mesh->num_quads;
+      for (int q = 0; q < count; q++) {
+        out[q].data[0] = info->quads[q].data[0] + offset;
+        out[q].data[1] = info->quads[q].data[1];
+        out[q].data[2] = info->quads[q].data[2] | sky;
+        out[q].data[3] = info->quads[q].data[3] | light_and_biome;
+      }
+      mesh->num_quads += count;
+    }
+  }
+}
+
+static MeshPass quad_pass(PackedQuad *q) {
+  return texture_pass[q->data[1] >> 20];
+}
+
+// The meshers fill mesh->groups[0..MESH_GROUPS) with the start of each group, this reorders
+// the quads so each pass is contiguous and fills in the full group table
+static void sort_quads_by_pass(SectionMesh *mesh) {
+  int group_start[MESH_GROUPS + 1];
+  memcpy(group_start, mesh->groups, MESH_GROUPS * sizeof(int));
+  group_start[MESH_GROUPS] = mesh->num_quads;
+
+  int counts[MESH_PASSES][MESH_GROUPS] = {0};
+  for (int g = 0; g < MESH_GROUPS; g++) {
+    for (int i = group_start[g]; i < group_start[g + 1]; i++) {
+      counts[quad_pass(&mesh->quads[i])][g]++;
+    }
+  }
+  int offset = 0;
+  for (int p = 0; p < MESH_PASSES; p++) {
+    for (int g = 0; g < MESH_GROUPS; g++) {
+      mesh->groups[PASS_GROUP(p, g)] = offset;
+      offset += counts[p][g];
+    }
+  }
+  mesh->groups[MESH_PASSES * MESH_GROUPS] = mesh->num_quads;
+  // Usually everything is opaque and the quads are already in order
+  if (mesh->groups[PASS_GROUP(MESH_PASS_CUTOUT, 0)] == mesh->num_quads) {
+    return;
+  }
+
+  if (mesh->spare == NULL) {
+    mesh->spare = malloc((size_t)mesh->capacity * sizeof(PackedQuad));
+  }
+  int next[MESH_PASSES * MESH_GROUPS];
+  memcpy(next, mesh->groups, sizeof(next));
+  for (int g = 0; g < MESH_GROUPS; g++) {
+    for (int i = group_start[g]; i < group_start[g + 1]; i++) {
+      mesh->spare[next[PASS_GROUP(quad_pass(&mesh->quads[i]), g)]++] = mesh->quads[i];
+    }
+  }
+  PackedQuad *sorted = mesh->spare;
+  mesh->spare = mesh->quads;
+  mesh->quads = sorted;
+}
+
+void chunk_section_build_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, SectionMesh *mesh) {
+  mesh->num_quads = 0;
+
+  // Create full blocks
+  if (section_no_full_blocks(section) || section_solid(section)) {
+    // Empty or solid sections can only have faces on the boundary with the neighbors below
+    for (int d = 0; d < 3; d++) {
+      for (int slice = 0; slice < CHUNK_SIZE; slice++) {
+        mesh->groups[SLICE_GROUP(d, slice)] = mesh->num_quads;
+        if (slice == 0 && !section_boundary_hidden(section, neighbors[d])) {
+          mesh_slice_greedy(section, neighbors, block_info, mesh, d, slice);
         }
       }
     }
+  } else if (chunk_get_mesher() == CHUNK_MESHER_BINARY) {
+    mesh_full_blocks_binary(section, neighbors, block_info, mesh);
+  } else {
+    mesh_full_blocks_greedy(section, neighbors, block_info, mesh);
+  }
+
+  // Create non-full blocks
+  for (int y = 0; y < CHUNK_SIZE; y++) {
+    mesh->groups[LAYER_GROUP(y)] = mesh->num_quads;
+    if (section->non_full_count > 0) {
+      mesh_layer_non_full(section, block_info, mesh, y);
+    }
+  }
+  sort_quads_by_pass(mesh);
+}
+
+void chunk_bake_block_quads(BlockInfo *info) {
+  info->quads = NULL;
+  info->num_quads = 0;
+  if (info->fullblock || info->mesh.num_elements == 0) {
+    return;
+  }
+
+  // Model coordinates stay within a block or two of the origin, far from the limits of the biased
+  // position fields, so adding the block offset later can't carry into the next field
+  SectionMesh mesh = section_mesh_create(info->mesh.num_elements * 6);
+  for (size_t el = 0; el < info->mesh.num_elements; el++) {
+    cubiod(&mesh, (vec3){0, 0, 0}, info->mesh.elements[el], info, 0, 0, 0);
+  }
+  info->quads = mesh.quads;
+  info->num_quads = mesh.num_quads;
+}
+
+void chunk_build_block_flags(BlockInfo *block_info, int num_states) {
+  free(block_flags);
+  block_flags = calloc(num_states, sizeof(BlockFlags));
+  for (int i = 1; i < num_states; i++) {
+    BlockInfo *info = &block_info[i];
+    BlockFlags flags = block_tint(info) << BLOCK_TINT_SHIFT;
+    if (info->fullblock) {
+      flags |= BLOCK_FULL;
+      if (!info->transparent) {
+        flags |= BLOCK_OPAQUE;
+      }
+    }
+    if (info->transparent) {
+      flags |= BLOCK_TRANSPARENT;
+    }
+    if (info->mesh.num_elements > 0) {
+      flags |= BLOCK_HAS_MODEL;
+    }
+    block_flags[i] = flags;
+  }
+}
+
+void chunk_build_texture_passes(BlockTextureSheet *sheet) {
+  memset(texture_pass, MESH_PASS_OPAQUE, sizeof(texture_pass));
+  int full_width = sheet->texture_size * sheet->width;
+  for (int id = 1; id <= sheet->current_id && id < (int)sizeof(texture_pass); id++) {
+    int tile_start_x = (id % sheet->width) * sheet->texture_size;
+    int tile_start_y = (id / sheet->width) * sheet->texture_size;
+    int clear = 0;
+    int partial = 0;
+    for (int y = 0; y < sheet->texture_size; y++) {
+      for (int x = 0; x < sheet->texture_size; x++) {
+        unsigned char alpha = sheet->data[((tile_start_y + y) * full_width + tile_start_x + x) * 4 + 3];
+        clear += alpha == 0;
+        partial += alpha > 0 && alpha < 255;
+      }
+    }
+    // A few soft pixels on the edge of a cutout texture aren't worth blending for
+    int visible = sheet->texture_size * sheet->texture_size - clear;
+    if (partial > 0 && partial * 4 >= visible) {
+      texture_pass[id] = MESH_PASS_TRANSLUCENT;
+    } else if (clear > 0 || partial > 0) {
+      texture_pass[id] = MESH_PASS_CUTOUT;
+    }
+  }
+}
+
+void chunk_set_quad_arena(QuadArena *arena) {
+  quad_arena = arena;
+}
+
+static void write_origin_and_quads(ChunkSection *section) {
+  // The first record holds the section origin in blocks, the quads are relative to it
+  PackedQuad origin = {{section->x * CHUNK_SIZE, section->y * CHUNK_SIZE, section->z * CHUNK_SIZE, 0}};
+  quad_arena_write(quad_arena, section->quad_range, 0, &origin, sizeof(PackedQuad));
+  quad_arena_write(quad_arena, section->quad_range, sizeof(PackedQuad), section->mesh.quads, section->mesh.num_quads * sizeof(PackedQuad));
+}
+
+static void write_section_quads(ChunkSection *section) {
+  SectionMesh *mesh = &section->mesh;
+  if (mesh->num_quads == 0) {
+    return;
   }
+  // Leave some room so block edits can usually patch the range instead of moving it
+  int capacity = mesh->num_quads + mesh->num_quads / 8 + 16;
+  if (!quad_arena_alloc(quad_arena, (capacity + 1) * sizeof(PackedQuad), &section->quad_range)) {
+    return;
+  }
+  section->quad_capacity = section->quad_range.size / sizeof(PackedQuad) - 1;
+  section->num_quads = mesh->num_quads;
+  write_origin_and_quads(section);
+}
 
-  if (section->vertex_buffer != NULL) {
-    wgpuBufferRelease(section->vertex_buffer);
-    section->vertex_buffer = NULL;
+bool chunk_section_move_quads(ChunkSection *section) {
+  QuadArenaRange range;
+  if (!quad_arena_alloc_below(quad_arena, section->quad_range.size, section->quad_range.page, &range)) {
+    return false;
   }
+  quad_arena_free(quad_arena, &section->quad_range);
+  section->quad_range = range;
+  write_origin_and_quads(section);
+  return true;
+}
 
-  section->vertex_buffer = frmwrk_device_create_buffer_init(
-    device,
-    &(const frmwrk_buffer_init_descriptor){
-      .label = "Vertex Buffer",
-      .content = (void *)quads,
-      .content_size = section->num_quads * 4 * FLOATS_PER_VERTEX * sizeof(float),
-      .usage = WGPUBufferUsage_Vertex,
+void chunk_section_upload_mesh(ChunkSection *section, SectionMesh *mesh) {
+  free_section_quads(section);
+  section_mesh_copy(&section->mesh, mesh);
+  section->has_mesh = true;
+  write_section_quads(section);
+}
+
+void chunk_section_update_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info) {
+  if (main_thread_mesh.quads == NULL) {
+    main_thread_mesh = section_mesh_create(MAX_QUADS_PER_SECTION);
+  }
+  chunk_section_build_mesh(section, neighbors, block_info, &main_thread_mesh);
+  chunk_section_upload_mesh(section, &main_thread_mesh);
+  // Any meshing job still in flight was built from older data
+  section->mesh_job = 0;
+}
+
+void chunk_section_patch_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, bool dirty[MESH_GROUPS]) {
+  // A queued job will replace the whole mesh anyway, so the uploaded one isn't worth patching
+  if (!section->has_mesh || section->mesh_job != 0) {
+    chunk_section_update_mesh(section, neighbors, block_info);
+    return;
+  }
+  if (main_thread_mesh.quads == NULL) {
+    main_thread_mesh = section_mesh_create(MAX_QUADS_PER_SECTION);
+  }
+  if (main_thread_patch.quads == NULL) {
+    main_thread_patch = section_mesh_create(MAX_QUADS_PER_SECTION);
+  }
+
+  // Rebuild the dirty groups on their own
+  SectionMesh *rebuilt = &main_thread_mesh;
+  rebuilt->num_quads = 0;
+  for (int g = 0; g < MESH_GROUPS; g++) {
+    rebuilt->groups[g] = rebuilt->num_quads;
+    if (!dirty[g]) {
+      continue;
+    }
+    if (g < LAYER_GROUP(0)) {
+      mesh_slice_greedy(section, neighbors, block_info, rebuilt, g / CHUNK_SIZE, g % CHUNK_SIZE);
+    } else {
+      mesh_layer_non_full(section, block_info, rebuilt, g - LAYER_GROUP(0));
+    }
+  }
+  sort_quads_by_pass(rebuilt);
+
+  // Splice them in between the old ones
+  SectionMesh *old = &section->mesh;
+  SectionMesh *mesh = &main_thread_patch;
+  mesh->num_quads = 0;
+  int first_changed = -1;
+  int last_changed = 0;
+  for (int i = 0; i < MESH_PASSES * MESH_GROUPS; i++) {
+    mesh->groups[i] = mesh->num_quads;
+    bool changed = dirty[i % MESH_GROUPS];
+    SectionMesh *src = changed ? rebuilt : old;
+    int count = src->groups[i + 1] - src->groups[i];
+    if (changed && first_changed < 0) {
+      first_changed = mesh->num_quads;
+    }
+    if (count > 0) {
+      memcpy(mesh->quads + mesh->num_quads, src->quads + src->groups[i], count * sizeof(PackedQuad));
+      mesh->num_quads += count;
+    }
+    if (changed) {
+      last_changed = mesh->num_quads;
     }
-  );
+  }
+  mesh->groups[MESH_PASSES * MESH_GROUPS] = mesh->num_quads;
+  if (first_changed < 0) {
+    return;
+  }
+
+  if (mesh->num_quads > section->quad_capacity) {
+    chunk_section_upload_mesh(section, mesh);
+    return;
+  }
+
+  // Everything after the first changed group moves unless the quad count stayed the same
+  if (mesh->num_quads != old->num_quads) {
+    last_changed = mesh->num_quads;
+  }
+  if (last_changed > first_changed) {
+    quad_arena_write(quad_arena, section->quad_range, (1 + first_changed) * sizeof(PackedQuad), mesh->quads + first_changed, (last_changed - first_changed) * sizeof(PackedQuad));
+  }
+  section->num_quads = mesh->num_quads;
+  section_mesh_copy(&section->mesh, mesh);
 }
@@ -3,8 +3,14 @@
 #include <cglm/cglm.h>
 #include <wgpu.h>
 
+#include "paletted_container.h"
+#include "quad_arena.h"
+#include "texture_sheet.h"
+
 #define FLOATS_PER_VERTEX 14
 #define CHUNK_SIZE 16
+// Every face of every block in a section
+#define MAX_QUADS_PER_SECTION (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 3)
 
 // y goes from -64 to 320
 // So each chunk is 24 sections tall
@@ -34,6 +40,16 @@ typedef struct Mesh {
   size_t num_elements;
 } Mesh;
 
+// One quad of a section mesh, vs_section in shader.wgsl expands it into 4 vertices
+// Positions are in 1/16 of a block relative to the section, texture coordinates in 1/16 of a tile
+// data[0]: x:9 y:9 z:9 (biased by 128), normal + 3:3, edge_axis:1, uv_axis:1
+// data[1]: edge1:10 edge2:10 (signed), texture:12
+// data[2]: u0:9 v0:9 u2:9, sky_light:4
+// data[3]: v2:9, block_light:4, tint:2, biome:7
+typedef struct PackedQuad {
+  uint32_t data[4];
+} PackedQuad;
+
 typedef struct BlockInfo {
   char* name;
   char* type;
@@ -45,6 +61,9 @@ typedef struct BlockInfo {
   bool dry_foliage;
   bool fullblock;
   Mesh mesh;
+  // The model of a non-full block as quads placed at the origin without light or biome, see chunk_bake_block_quads
+  PackedQuad *quads;
+  int num_quads;
 } BlockInfo;
 
 typedef struct BiomeInfo {
@@ -75,38 +94,137 @@ typedef struct ChunkVertex {
 } ChunkVertex;
 #pragma pack(pop)
 
-typedef struct CompressedChunkVertex {
-  vec3 position;
-  uint16_t material;
-  uint8_t color_r;
-  uint8_t color_g;
-  uint8_t color_b;
-  uint8_t color_a;
-  unsigned int sky_light : 4;
-  unsigned int block_light : 4;
-  int normal : 2;
-  vec2 coord;
-} CompressedChunkVertex;
+// Which biome color a face is multiplied with, looked up by the shader
+typedef enum TintType {
+  TINT_NONE,
+  TINT_GRASS,
+  TINT_FOLIAGE,
+  TINT_DRY_FOLIAGE,
+} TintType;
+
+// Compact per block state copy of what the mesher reads from BlockInfo, built by chunk_build_block_flags
+#define BLOCK_FULL (1 << 0)
+#define BLOCK_OPAQUE (1 << 1) // A full block that isn't transparent
+#define BLOCK_TRANSPARENT (1 << 2)
+#define BLOCK_HAS_MODEL (1 << 3)
+#define BLOCK_TINT_SHIFT 4 // The TintType is stored in the top bits
+#define BLOCK_TINT(flags) ((TintType)((flags) >> BLOCK_TINT_SHIFT))
+typedef uint8_t BlockFlags;
+
+// Quads are grouped so an edit only rebuilds the groups it touches:
+// one per full block slice along each axis, then one per y layer of non-full blocks
+#define SLICE_GROUP(d, slice) ((d) * CHUNK_SIZE + (slice))
+#define LAYER_GROUP(y) (3 * CHUNK_SIZE + (y))
+#define MESH_GROUPS (4 * CHUNK_SIZE)
+
+// Each group is split by how its quads are drawn, picked from the texture's alpha
+typedef enum MeshPass {
+  MESH_PASS_OPAQUE, // No transparent pixels, drawn without discard so early depth testing works
+  MESH_PASS_CUTOUT, // Pixels are either fully transparent or opaque
+  MESH_PASS_TRANSLUCENT, // Blended, drawn after everything else
+  MESH_PASSES,
+} MeshPass;
+#define PASS_GROUP(pass, group) ((pass) * MESH_GROUPS + (group))
+
+// CPU side quads for a section, filled by chunk_section_build_mesh
+typedef struct SectionMesh {
+  PackedQuad *quads;
+  int num_quads;
+  int capacity; // In quads
+  // First quad of each group, ordered by pass and then group so every pass is one range,
+  // the last entry is num_quads
+  int groups[MESH_PASSES * MESH_GROUPS + 1];
+  PackedQuad *spare; // Same capacity as quads, allocated the first time quads are sorted into passes
+} SectionMesh;
 
 typedef struct ChunkSection {
   int x;
   int y;
   int z;
-  int data[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
-  uint8_t sky_light[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
-  uint8_t block_light[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
-  int biome_data[4 * 4 * 4];
-  WGPUBuffer vertex_buffer;
+  PalettedContainer blocks; // Block states, indexed by x + CHUNK_SIZE * (z + CHUNK_SIZE * y)
+  // Two values per byte as they come from the server, read them with light_get
+  uint8_t sky_light[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE / 2];
+  uint8_t block_light[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE / 2];
+  PalettedContainer biomes; // 4x4x4 cells, indexed like blocks
+  // Summary of blocks so the mesher can skip work, kept up to date by chunk_section_set_block
+  int non_air_count;
+  int non_full_count; // Non-air blocks that aren't full blocks
+  int transparent_count;
+  QuadArenaRange quad_range; // Section origin followed by the PackedQuads, nothing is allocated for empty meshes
+  bool has_mesh; // A mesh was uploaded, even if it has no quads
   int num_quads;
+  int quad_capacity; // Quads that fit in quad_range
+  SectionMesh mesh; // Copy of the quads in quad_range, so block edits can patch it and the arena can move it
+  unsigned int mesh_job; // Id of the meshing job whose result is still wanted, 0 if none
+  uint64_t dirty_groups; // Bit per mesh group edited since the world last patched the mesh
 } ChunkSection;
 
+// Reads one value of nibble packed light, the even index is in the low nibble
+static inline int light_get(const uint8_t *light, int index) {
+  return (light[index >> 1] >> ((index & 1) * 4)) & 0xF;
+}
+
+// Bits of Chunk.loaded_neighbors
+#define CHUNK_NEIGHBOR_X (1 << 0) // The chunk at x - 1 is loaded
+#define CHUNK_NEIGHBOR_Z (1 << 1) // The chunk at z - 1 is loaded
+// Meshing a section reads the -x and -z chunks, so it can start once both are loaded
+#define CHUNK_NEIGHBORS_READY (CHUNK_NEIGHBOR_X | CHUNK_NEIGHBOR_Z)
+
 typedef struct Chunk {
   int x;
   int z;
+  uint8_t loaded_neighbors; // Kept up to date by the world as chunks come and go
+  bool mesh_queued; // Waiting in the world's pending chunks
   ChunkSection sections[Y_SECTIONS];
 } Chunk;
 
+// Which engine meshes the full blocks, both produce the same quads
+typedef enum ChunkMesher {
+  CHUNK_MESHER_GREEDY, // Per slice material mask, merged cell by cell
+  CHUNK_MESHER_BINARY, // Per column bitmasks, merged on bit rows
+} ChunkMesher;
+
 void chunk_destroy_buffers(Chunk *chunk);
+// Frees the meshes and block storage but not the chunk itself
+void chunk_release_storage(Chunk *chunk);
 void chunk_destroy(Chunk *chunk);
 
-void chunk_section_update_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device);
+// Bakes the quads of a non-full block's model so meshing only has to move them into place
+void chunk_bake_block_quads(BlockInfo *info);
+// Builds the flag table from the loaded blocks, must be called before anything is meshed
+void chunk_build_block_flags(BlockInfo *block_info, int num_states);
+// Sorts the textures of the sheet into mesh passes by their alpha, must be called before anything is meshed
+void chunk_build_texture_passes(BlockTextureSheet *sheet);
+// The arena section quads are uploaded to, must be set before meshes are uploaded
+void chunk_set_quad_arena(QuadArena *arena);
+void chunk_set_mesher(ChunkMesher mesher);
+ChunkMesher chunk_get_mesher();
+
+// Recounts the summary of a section from its blocks
+void chunk_section_count_blocks(ChunkSection *section);
+// index is x + CHUNK_SIZE * (z + CHUNK_SIZE * y)
+int chunk_section_get_block(ChunkSection *section, int index);
+void chunk_section_set_block(ChunkSection *section, int index, int state);
+// Expands count light values starting at start into one byte each, start and count must be even
+void chunk_unpack_light(const uint8_t *light, int start, int count, uint8_t *out);
+// Copies a section for another thread to read, the copy owns its blocks and biomes
+// and must be freed with chunk_section_destroy_copy
+void chunk_section_copy(ChunkSection *dst, ChunkSection *src);
+void chunk_section_destroy_copy(ChunkSection *section);
+
+SectionMesh section_mesh_create(int capacity);
+void section_mesh_destroy(SectionMesh *mesh);
+// Copies the quads and groups, growing dst if needed
+void section_mesh_copy(SectionMesh *dst, SectionMesh *src);
+
+// Builds the quads for a section without touching the GPU, safe to call from any thread
+void chunk_section_build_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, SectionMesh *mesh);
+// Replaces the section's quads with the contents of mesh, must be called from the main thread
+void chunk_section_upload_mesh(ChunkSection *section, SectionMesh *mesh);
+void chunk_section_update_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info);
+// Rebuilds only the dirty groups and rewrites the part of the quad buffer that changed,
+// falls back to a full update when the section has no mesh to patch
+void chunk_section_patch_mesh(ChunkSection *section, ChunkSection *neighbors[3], BlockInfo *block_info, bool dirty[MESH_GROUPS]);
+// Rewrites the section's retained quads to a range in an earlier page of the arena, used to
+// compact it. Returns false and leaves the range alone if no earlier page has room.
+bool chunk_section_move_quads(ChunkSection *section);
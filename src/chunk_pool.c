@@ -0,0 +1,118 @@
+#define _DEFAULT_SOURCE
+#include "chunk_pool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "logging.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Tries explicit huge pages, then asks for transparent ones on the normal mapping
+static void *reserve(size_t bytes, bool huge_pages, bool *got_huge_pages) {
+  *got_huge_pages = false;
+#ifdef MAP_HUGETLB
+  if (huge_pages) {
+    // Without MAP_NORESERVE the mapping fails up front when too few huge pages are set aside,
+    // instead of faulting on the first touch of a page that isn't there
+    void *memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      *got_huge_pages = true;
+      return memory;
+    }
+  }
+#endif
+  void *memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    *got_huge_pages = madvise(memory, bytes, MADV_HUGEPAGE) == 0;
+  }
+#endif
+  return memory;
+}
+
+// Adds a slab and makes it the one new chunks come from
+static bool add_slab(ChunkPool *pool) {
+  if (pool->num_slabs == CHUNK_POOL_MAX_SLABS) {
+    return false;
+  }
+  bool got_huge_pages;
+  Chunk *slab = reserve(pool->slab_bytes, pool->huge_pages, &got_huge_pages);
+  if (slab == NULL) {
+    return false;
+  }
+  pool->slabs[pool->num_slabs++] = slab;
+  pool->huge_page_slabs += got_huge_pages;
+  pool->slab_used = 0;
+  pool->free = realloc(pool->free, pool->num_slabs * pool->slab_chunks * sizeof(Chunk *));
+  return true;
+}
+
+ChunkPool *chunk_pool_create(int slab_chunks, bool huge_pages) {
+  ChunkPool *pool = calloc(1, sizeof(ChunkPool));
+  pool->slab_chunks = slab_chunks;
+  pool->slab_bytes = (slab_chunks * sizeof(Chunk) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  pool->huge_pages = huge_pages;
+  if (!add_slab(pool)) {
+    FATAL("Couldn't reserve %zu MB for chunks", pool->slab_bytes >> 20);
+    assert(false);
+  }
+  return pool;
+}
+
+void chunk_pool_destroy(ChunkPool *pool) {
+  if (pool->in_use > 0) {
+    WARN("Destroying the chunk pool with %d chunks in use", pool->in_use);
+  }
+  for (int i = 0; i < pool->num_slabs; i++) {
+    munmap(pool->slabs[i], pool->slab_bytes);
+  }
+  free(pool->free);
+  free(pool);
+}
+
+Chunk *chunk_pool_alloc(ChunkPool *pool) {
+  Chunk *chunk;
+  if (pool->num_free > 0) {
+    chunk = pool->free[--pool->num_free];
+    memset(chunk, 0, sizeof(Chunk));
+  } else {
+    if (pool->slab_used == pool->slab_chunks && !add_slab(pool)) {
+      FATAL("Couldn't reserve another %zu MB for chunks", pool->slab_bytes >> 20);
+      assert(false);
+      return NULL;
+    }
+    // Fresh slab memory is already zero
+    chunk = &pool->slabs[pool->num_slabs - 1][pool->slab_used++];
+  }
+  pool->in_use++;
+  if (pool->in_use > pool->high_water) {
+    pool->high_water = pool->in_use;
+  }
+  return chunk;
+}
+
+void chunk_pool_release(ChunkPool *pool, Chunk *chunk) {
+  chunk_release_storage(chunk);
+  pool->in_use--;
+  pool->free[pool->num_free++] = chunk;
+}
+
+void chunk_pool_report(ChunkPool *pool) {
+  int touched = (pool->num_slabs - 1) * pool->slab_chunks + pool->slab_used;
+  INFO(
+    "Chunk pool: %d of %d chunks in use, high water %d, %.1f of %.1f MB touched in %d slabs (%d with huge pages)",
+    pool->in_use,
+    pool->num_slabs * pool->slab_chunks,
+    pool->high_water,
+    touched * sizeof(Chunk) / (1024.0 * 1024.0),
+    pool->num_slabs * pool->slab_bytes / (1024.0 * 1024.0),
+    pool->num_slabs,
+    pool->huge_page_slabs
+  );
+}
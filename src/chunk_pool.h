@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chunk.h"
+
+#define CHUNK_POOL_MAX_SLABS 64
+// About 30 MB, a view distance of 5 fits in one slab
+#define CHUNK_POOL_SLAB_CHUNKS 256
+
+// Recycles chunks out of slabs reserved up front, so loading and unloading them as the
+// player moves doesn't go through malloc or fault in fresh pages for every chunk
+typedef struct ChunkPool {
+  Chunk *slabs[CHUNK_POOL_MAX_SLABS];
+  int num_slabs;
+  int slab_chunks; // Chunks that fit in one slab
+  size_t slab_bytes;
+  bool huge_pages; // Asked for on every slab
+  int huge_page_slabs; // Slabs that got huge pages, explicit or transparent
+  int slab_used; // Chunks handed out from the last slab, the rest have never been touched
+  Chunk **free; // Released chunks, their storage is reused before touching new slab memory
+  int num_free;
+  int in_use;
+  int high_water;
+} ChunkPool;
+
+// Reserves the first slab of slab_chunks chunks, more are added as they're needed. The
+// memory is only committed as chunks are handed out.
+ChunkPool *chunk_pool_create(int slab_chunks, bool huge_pages);
+// Every chunk must have been released first
+void chunk_pool_destroy(ChunkPool *pool);
+
+// A zeroed chunk, like calloc
+Chunk *chunk_pool_alloc(ChunkPool *pool);
+// Frees what the chunk owns (meshes and block storage) and keeps the chunk for the next alloc
+void chunk_pool_release(ChunkPool *pool, Chunk *chunk);
+// Logs occupancy, the high-water mark and how much memory is reserved
+void chunk_pool_report(ChunkPool *pool);
@@ -82,7 +82,7 @@ typedef struct EntityRenderer {
   WGPUBuffer uniform_buffer;
   WGPUBuffer vertex_buffer;
   WGPUBuffer instance_buffer;
-  EntityInstance instance_data[MAX_ENTITIES];
+  int instance_capacity; // Instances the buffer holds, follows the world's entity slots
 } EntityRenderer;
 
 typedef struct BlockBeingBroken {
@@ -102,11 +102,14 @@ typedef struct Game {
   WGPUTexture depth_texture;
   WGPUBuffer index_buffer;
   WGPUBindGroup bind_group;
-  WGPURenderPipeline render_pipeline;
+  WGPURenderPipeline section_pipelines[MESH_PASSES]; // Indexed by MeshPass
   WGPURenderPipeline render_pipeline_transparent;
   WGPUBuffer uniform_buffer;
   Uniforms uniforms;
+  WGPUBuffer tint_buffer;
+  vec4 tints[MAX_BIOMES * 3]; // Grass, foliage and dry foliage color of each biome
   WGPUPipelineLayout pipeline_layout;
+  WGPUPipelineLayout section_pipeline_layout;
   WGPUShaderModule shader_module;
   SkyRenderer sky_renderer;
   BlockSelectedRenderer block_selected_renderer;
@@ -133,12 +136,15 @@ typedef struct Game {
   vec3 look;
   long time_of_day;
   World world;
+  MeshPool *mesh_pool;
+  QuadArena *quad_arena;
   mcapiConnection *conn;
   BlockTextureSheet texture_sheet;
   unsigned char texture_sheet_data[TEXTURE_SIZE * TEXTURE_SIZE * TEXTURE_TILES * TEXTURE_TILES * 4];
   EntityTextureSheet entity_sheet;
   unsigned char entity_sheet_data[ENTITY_SHEET_X * ENTITY_SHEET_Y * 4];
   double target_render_time;
+  double remesh_budget; // Seconds per frame spent patching edited sections and queueing new chunks
   double last_render_time;
   double target_tick_time;
   double last_tick_time;
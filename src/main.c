@@ -100,6 +100,12 @@ static void handle_glfw_key(
           WGPUGlobalReport report;
           wgpuGenerateReport(game.instance, &report);
           frmwrk_print_global_report(report);
+          chunk_pool_report(game.world.chunk_pool);
+          break;
+        case GLFW_KEY_M:
+          chunk_set_mesher(chunk_get_mesher() == CHUNK_MESHER_BINARY ? CHUNK_MESHER_GREEDY : CHUNK_MESHER_BINARY);
+          INFO("Meshing full blocks with the %s mesher", chunk_get_mesher() == CHUNK_MESHER_BINARY ? "binary" : "greedy");
+          world_remesh_all(&game.world, game.mesh_pool);
           break;
       }
       break;
@@ -206,7 +212,7 @@ static void handle_glfw_set_mouse_button(GLFWwindow *window, int button, int act
           case GLFW_MOUSE_BUTTON_RIGHT:
             vec3 air_position;
             glm_vec3_add(target, normal, air_position);
-            world_set_block(&game.world, air_position, 1, game.block_info, game.biome_info, game.device);
+            world_set_block(&game.world, air_position, 1);
             break;
         }
       }
@@ -236,13 +242,14 @@ void game_update_player_y(float delta) {
   glm_vec3_copy(game.position, p);
   float new_y = p[1] + delta;
   vec3 sz = {game.size[0] / 2, game.size[1], game.size[2] / 2};
-  World *w = &game.world;
+  // The corners checked are all next to each other, usually in one section
+  BlockAccessor blocks = block_accessor_create(&game.world);
 
   // Move +y
   if (delta > 0 && floor(new_y + sz[1]) > floor(p[1] + sz[1])) {
     for (int dx = -1; dx <= 1; dx += 2) {
       for (int dz = -1; dz <= 1; dz += 2) {
-        int m = world_get_material(w, (vec3){p[0] + dx * sz[0], new_y + sz[1], p[2] + dz * sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){p[0] + dx * sz[0], new_y + sz[1], p[2] + dz * sz[2]});
         if (!game.block_info[m].passable) {
           game.position[1] = floor(new_y + sz[1]) - sz[1] - COLLISION_EPSILON;
           game.velocity[1] = 0;
@@ -256,7 +263,7 @@ void game_update_player_y(float delta) {
   if (delta < 0 && floor(new_y) < floor(p[1])) {
     for (int dx = -1; dx <= 1; dx += 2) {
       for (int dz = -1; dz <= 1; dz += 2) {
-        int m = world_get_material(w, (vec3){p[0] + dx * sz[0], new_y, p[2] + dz * sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){p[0] + dx * sz[0], new_y, p[2] + dz * sz[2]});
         if (!game.block_info[m].passable) {
           game.position[1] = ceil(new_y) + COLLISION_EPSILON;
           game.velocity[1] = 0;
@@ -278,13 +285,13 @@ void game_update_player_x(float delta) {
   glm_vec3_copy(game.position, p);
   float new_x = p[0] + delta;
   vec3 sz = {game.size[0] / 2, game.size[1], game.size[2] / 2};
-  World *w = &game.world;
+  BlockAccessor blocks = block_accessor_create(&game.world);
 
   // Move +x
   if (delta > 0 && floor(new_x + sz[0]) > floor(p[0] + sz[0])) {
     for (int dz = -1; dz <= 1; dz += 2) {
       for (int dy = 0; dy <= 2; dy += 1) {
-        int m = world_get_material(w, (vec3){new_x + sz[0], p[1] + 0.5f * dy * sz[1], p[2] + dz * sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){new_x + sz[0], p[1] + 0.5f * dy * sz[1], p[2] + dz * sz[2]});
         if (!game.block_info[m].passable) {
           game.position[0] = floor(new_x + sz[0]) - sz[0] - COLLISION_EPSILON;
           game.velocity[0] = 0;
@@ -297,7 +304,7 @@ void game_update_player_x(float delta) {
   if (delta < 0 && floor(new_x - sz[0]) < floor(p[0] - sz[0])) {
     for (int dz = -1; dz <= 1; dz += 2) {
       for (int dy = 0; dy <= 2; dy += 1) {
-        int m = world_get_material(w, (vec3){new_x - sz[0], p[1] + 0.5f * dy * sz[1], p[2] + dz * sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){new_x - sz[0], p[1] + 0.5f * dy * sz[1], p[2] + dz * sz[2]});
         if (!game.block_info[m].passable) {
           game.position[0] = ceil(new_x - sz[0]) + sz[0] + COLLISION_EPSILON;
           game.velocity[0] = 0;
@@ -314,13 +321,13 @@ void game_update_player_z(float delta) {
   glm_vec3_copy(game.position, p);
   float new_z = p[2] + delta;
   vec3 sz = {game.size[0] / 2, game.size[1], game.size[2] / 2};
-  World *w = &game.world;
+  BlockAccessor blocks = block_accessor_create(&game.world);
 
   // Move +z
   if (delta > 0 && floor(new_z + sz[2]) > floor(p[2] + sz[2])) {
     for (int dx = -1; dx <= 1; dx += 2) {
       for (int dy = 0; dy <= 2; dy += 1) {
-        int m = world_get_material(w, (vec3){p[0] + dx * sz[0], p[1] + 0.5f * dy * sz[1], new_z + sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){p[0] + dx * sz[0], p[1] + 0.5f * dy * sz[1], new_z + sz[2]});
         if (!game.block_info[m].passable) {
           game.position[2] = floor(new_z + sz[2]) - sz[2] - COLLISION_EPSILON;
           game.velocity[2] = 0;
@@ -333,7 +340,7 @@ void game_update_player_z(float delta) {
   if (delta < 0 && floor(new_z - sz[2]) < floor(p[2] - sz[2])) {
     for (int dx = -1; dx <= 1; dx += 2) {
       for (int dy = 0; dy <= 2; dy += 1) {
-        int m = world_get_material(w, (vec3){p[0] + dx * sz[0], p[1] + 0.5f * dy * sz[1], new_z - sz[2]});
+        int m = block_accessor_at(&blocks, (vec3){p[0] + dx * sz[0], p[1] + 0.5f * dy * sz[1], new_z - sz[2]});
         if (!game.block_info[m].passable) {
           game.position[2] = ceil(new_z - sz[2]) + sz[2] + COLLISION_EPSILON;
           game.velocity[2] = 0;
@@ -454,6 +461,16 @@ void int_to_rgb(int color, vec3 result) {
   );
 }
 
+// Copies the biome colors into the table the chunk shader tints faces with
+void chunk_renderer_update_tints() {
+  for (int i = 0; i < MAX_BIOMES; i++) {
+    glm_vec3_copy(game.biome_info[i].grass_color, game.tints[i * 3 + TINT_GRASS - 1]);
+    glm_vec3_copy(game.biome_info[i].foliage_color, game.tints[i * 3 + TINT_FOLIAGE - 1]);
+    glm_vec3_copy(game.biome_info[i].dry_foliage_color, game.tints[i * 3 + TINT_DRY_FOLIAGE - 1]);
+  }
+  wgpuQueueWriteBuffer(game.queue, game.tint_buffer, 0, game.tints, sizeof(game.tints));
+}
+
 void on_registry(mcapiConnection *UNUSED(conn), mcapiRegistryDataPacket *packet) {
   if (strcmp(packet->id, "minecraft:worldgen/biome") == 0) {
     unsigned int width;
@@ -530,6 +547,7 @@ void on_registry(mcapiConnection *UNUSED(conn), mcapiRegistryDataPacket *packet)
     }
     free(grass);
     free(foliage);
+    chunk_renderer_update_tints();
   }
 }
 
@@ -542,32 +560,14 @@ void on_finish_config(mcapiConnection *conn, void* UNUSED(payload)) {
 }
 
 void on_chunk(mcapiConnection *UNUSED(conn), mcapiChunkAndLightDataPacket* packet) {
-  Chunk *chunk = world_chunk(&game.world, packet->chunk_x, packet->chunk_z);
-  bool is_new = false;
-  if (chunk == NULL) {
-    chunk = calloc(1, sizeof(Chunk));
-    is_new = true;
-  } else {
-    // Reset chunk mesh
-    chunk_destroy_buffers(chunk);
-  }
+  Chunk *chunk = world_load_chunk(&game.world, packet);
+  world_queue_chunk_meshes(&game.world, chunk);
+}
 
-  chunk->x = packet->chunk_x;
-  chunk->z = packet->chunk_z;
-  for (int i = 0; i < 24; i++) {
-    chunk->sections[i].num_quads = 0;
-    chunk->sections[i].x = packet->chunk_x;
-    chunk->sections[i].y = i - 4;
-    chunk->sections[i].z = packet->chunk_z;
-    memcpy(chunk->sections[i].data, packet->chunk_sections[i].blocks, 4096 * sizeof(int));
-    memcpy(chunk->sections[i].biome_data, packet->chunk_sections[i].biomes, 64 * sizeof(int));
-    memcpy(chunk->sections[i].sky_light, packet->sky_light_array[i + 1], 4096);
-    memcpy(chunk->sections[i].block_light, packet->block_light_array[i + 1], 4096);
-  }
-  if (is_new) {
-    world_add_chunk(&game.world, chunk);
-  }
-  world_init_new_meshes(&game.world, game.block_info, game.biome_info, game.device);
+void on_chunk_cache_radius(mcapiConnection *UNUSED(conn), mcapiSetChunkCacheRadiusPacket *packet) {
+  // Like the vanilla client, keep chunks up to 3 past the view distance before they're unloaded
+  int diameter = 2 * (packet->view_distance + 3) + 1;
+  world_reserve_chunks(&game.world, diameter * diameter);
 }
 
 void on_unload_chunk(mcapiConnection *, mcapiUnloadChunk *p) {
@@ -584,10 +584,9 @@ void on_light(mcapiConnection *UNUSED(conn), mcapiUpdateLightPacket *packet) {
   }
   // perror("In!\n");
   for (int i = 0; i < 24; i++) {
-    memcpy(chunk->sections[i].sky_light, packet->sky_light_array[i + 1], 4096);
-    memcpy(chunk->sections[i].block_light, packet->block_light_array[i + 1], 4096);
+    mcapi_copy_light(&packet->light, i + 1, chunk->sections[i].sky_light, chunk->sections[i].block_light);
   }
-  world_init_new_meshes(&game.world, game.block_info, game.biome_info, game.device);
+  world_queue_chunk_meshes(&game.world, chunk);
 }
 
 void on_block_update(mcapiConnection *UNUSED(conn), mcapiBlockUpdatePacket *packet) {
@@ -598,7 +597,7 @@ void on_block_update(mcapiConnection *UNUSED(conn), mcapiBlockUpdatePacket *pack
 
   DEBUG("Block update %d %d %d", packet->position[0], packet->position[1], packet->position[2]);
 
-  world_set_block(&game.world, pos, packet->block_id, game.block_info, game.biome_info, game.device);
+  world_set_block(&game.world, pos, packet->block_id);
 }
 
 void on_position(mcapiConnection *conn, mcapiSynchronizePlayerPositionPacket *packet) {
@@ -642,6 +641,34 @@ void on_clientbound_keepalive(mcapiConnection *conn, mcapiClientboundKeepAlivePa
   mcapi_send_serverbound_keepalive(conn, (mcapiServerboundKeepalivePacket) {.id = packet->keep_alive_id});
 }
 
+// Buffers are created zeroed, so unused instances are harmless
+static void entity_renderer_create_instance_buffer(int capacity) {
+  game.entity_renderer.instance_buffer = wgpuDeviceCreateBuffer(
+    game.device,
+    &(WGPUBufferDescriptor){
+      .label = "Entity Instance Buffer",
+      .size = capacity * sizeof(EntityInstance),
+      .usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst,
+    }
+  );
+  game.entity_renderer.instance_capacity = capacity;
+}
+
+// Gives the instance buffer one instance per entity slot, rewriting every entity when the slots
+// were resized since the world moves entities to new slots when it does
+static void entity_renderer_fit_instances() {
+  if (game.world.entity_capacity == 0 || game.world.entity_capacity == game.entity_renderer.instance_capacity) {
+    return;
+  }
+  wgpuBufferRelease(game.entity_renderer.instance_buffer);
+  entity_renderer_create_instance_buffer(game.world.entity_capacity);
+  for (int i = 0; i < game.world.entity_slots_used; i++) {
+    Entity *entity = game.world.entities[i];
+    if (entity != NULL) {
+      entity_update_instance_buffer(entity, entity->index, game.queue, game.entity_renderer.instance_buffer);
+    }
+  }
+}
 void on_add_entity(mcapiConnection*, mcapiAddEntityPacket *p) {
   DEBUG("add_entity id: %d type %d x %.2f y %.2f z %.2f pitch %d yaw %d yaw_head %d data %d vx %d vy %d vz %d",
     p->id, p->type, p->x, p->y, p->z, p->pitch, p->yaw, p->yaw_head, p->data, p->vx, p->vy, p->vz);
@@ -652,8 +679,9 @@ void on_add_entity(mcapiConnection*, mcapiAddEntityPacket *p) {
   entity->pos[0] = p->x;
   entity->pos[1] = p->y;
   entity->pos[2] = p->z;
-  int index = world_add_entity(&game.world, entity);
-  entity_update_instance_buffer(entity, index, game.queue, game.entity_renderer.instance_buffer);
+  world_add_entity(&game.world, entity);
+  entity_renderer_fit_instances();
+  entity_update_instance_buffer(entity, entity->index, game.queue, game.entity_renderer.instance_buffer);
 }
 
 void on_update_entity_pos(mcapiConnection*, mcapiUpdateEntityPositionPacket *p) {
@@ -690,11 +718,29 @@ void on_remove_entities(mcapiConnection *, mcapiRemoveEntitiesPacket *p) {
   for (int i = 0; i < p->entity_count; i++) {
     world_destroy_entity(&game.world, p->entity_ids[i]);
   }
+  entity_renderer_fit_instances();
 }
 
 void init_mcapi(char *server_ip, int port, char *uuid, char *access_token, char *username) {
-  mcapiConnection *conn = mcapi_create_connection(server_ip, port, uuid, access_token);
+  // Set CMC_REPLAY to a capture file to play it back instead of connecting, CMC_REPLAY_SPEED 0 replays it as fast as possible
+  char *replay_file = getenv("CMC_REPLAY");
+  mcapiConnection *conn;
+  if (replay_file != NULL) {
+    char *speed = getenv("CMC_REPLAY_SPEED");
+    conn = mcapi_create_replay_connection(replay_file, speed != NULL ? atof(speed) : 1.0);
+    if (conn == NULL) {
+      FATAL("Couldn't replay %s", replay_file);
+      exit(1);
+    }
+  } else {
+    conn = mcapi_create_connection(server_ip, port, uuid, access_token);
+  }
   game.conn = conn;
+  // Set CMC_CAPTURE to a filename to record the session's packets
+  char *capture_file = getenv("CMC_CAPTURE");
+  if (capture_file != NULL) {
+    mcapi_start_capture(conn, capture_file);
+  }
 
   mcapi_send_handshake(
     conn,
@@ -726,6 +772,7 @@ void init_mcapi(char *server_ip, int port, char *uuid, char *access_token, char
   mcapi_set_finish_config_cb(conn, on_finish_config);
   mcapi_set_chunk_and_light_data_cb(conn, on_chunk);
   mcapi_set_unload_chunk_cb(conn, on_unload_chunk);
+  mcapi_set_chunk_cache_radius_cb(conn, on_chunk_cache_radius);
   mcapi_set_update_light_cb(conn, on_light);
   mcapi_set_block_update_cb(conn, on_block_update);
   mcapi_set_synchronize_player_position_cb(conn, on_position);
@@ -828,6 +875,16 @@ void chunk_renderer_init() {
     }
   );
 
+  game.tint_buffer = frmwrk_device_create_buffer_init(
+    game.device,
+    &(const frmwrk_buffer_init_descriptor){
+      .label = "Tint Buffer",
+      .content = (void *)game.tints,
+      .content_size = sizeof(game.tints),
+      .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+    }
+  );
+
   WGPUBindGroupLayoutEntry bgl_entries[] = {
     [0] = {
       .binding = 0,
@@ -852,6 +909,13 @@ void chunk_renderer_init() {
         .type = WGPUSamplerBindingType_Filtering,
       },
     },
+    [3] = {
+      .binding = 3,
+      .visibility = WGPUShaderStage_Vertex,
+      .buffer = {
+        .type = WGPUBufferBindingType_Uniform,
+      },
+    },
   };
 
   WGPUBindGroupLayoutDescriptor bgl_desc = {
@@ -875,6 +939,11 @@ void chunk_renderer_init() {
       .binding = 2,
       .sampler = texture_sampler,
     },
+    [3] = {
+      .binding = 3,
+      .buffer = game.tint_buffer,
+      .size = sizeof(game.tints),
+    },
   };
   WGPUBindGroupDescriptor bg_desc = {
     .layout = bgl,
@@ -961,64 +1030,106 @@ void chunk_renderer_init() {
   );
   assert(game.pipeline_layout);
 
-  game.render_pipeline = wgpuDeviceCreateRenderPipeline(
+  // Sections bind their range of the quad arena with a dynamic offset, vs_section pulls the vertices from it
+  WGPUBindGroupLayout section_bgl = wgpuDeviceCreateBindGroupLayout(
     game.device,
-    &(const WGPURenderPipelineDescriptor){
-      .label = "game.render_pipeline",
-      .layout = game.pipeline_layout,
-      .vertex = (const WGPUVertexState){
-        .module = game.shader_module,
-        .entryPoint = "vs_main",
-        .bufferCount = 1,
-        .buffers = (const WGPUVertexBufferLayout[]){
-          (const WGPUVertexBufferLayout){
-            .arrayStride = FLOATS_PER_VERTEX * sizeof(float),
-            .stepMode = WGPUVertexStepMode_Vertex,
-            .attributeCount = sizeof(vertex_attributes) /
-                              sizeof(vertex_attributes[0]),
-            .attributes = vertex_attributes,
+    &(const WGPUBindGroupLayoutDescriptor){
+      .entryCount = 1,
+      .entries = (const WGPUBindGroupLayoutEntry[]){
+        {
+          .binding = 0,
+          .visibility = WGPUShaderStage_Vertex,
+          .buffer = {
+            .type = WGPUBufferBindingType_ReadOnlyStorage,
+            .hasDynamicOffset = true,
           },
         },
       },
-      .fragment = &(const WGPUFragmentState){
-        .module = game.shader_module,
-        .entryPoint = "fs_main",
-        .targetCount = 1,
-        .targets = (const WGPUColorTargetState[]){
-          (const WGPUColorTargetState){
-            .format = game.surface_capabilities.formats[0],
-            .writeMask = WGPUColorWriteMask_All,
+    }
+  );
+  game.quad_arena = quad_arena_create(game.device, section_bgl, (MAX_QUADS_PER_SECTION + 1) * sizeof(PackedQuad));
+  chunk_set_quad_arena(game.quad_arena);
+
+  game.section_pipeline_layout = wgpuDeviceCreatePipelineLayout(
+    game.device,
+    &(const WGPUPipelineLayoutDescriptor){
+      .label = "game.section_pipeline_layout",
+      .bindGroupLayoutCount = 2,
+      .bindGroupLayouts = (const WGPUBindGroupLayout[]){
+        bgl,
+        section_bgl,
+      },
+    }
+  );
+  assert(game.section_pipeline_layout);
+
+  // Opaque quads skip the discard, translucent ones are blended and don't write depth
+  const char *section_labels[MESH_PASSES] = {"Opaque Section Pipeline", "Cutout Section Pipeline", "Translucent Section Pipeline"};
+  const char *section_fragment_entries[MESH_PASSES] = {"fs_opaque", "fs_main", "fs_main"};
+  for (int pass = 0; pass < MESH_PASSES; pass++) {
+    bool translucent = pass == MESH_PASS_TRANSLUCENT;
+    game.section_pipelines[pass] = wgpuDeviceCreateRenderPipeline(
+      game.device,
+      &(const WGPURenderPipelineDescriptor){
+        .label = section_labels[pass],
+        .layout = game.section_pipeline_layout,
+        .vertex = (const WGPUVertexState){
+          .module = game.shader_module,
+          .entryPoint = "vs_section",
+        },
+        .fragment = &(const WGPUFragmentState){
+          .module = game.shader_module,
+          .entryPoint = section_fragment_entries[pass],
+          .targetCount = 1,
+          .targets = (const WGPUColorTargetState[]){
+            (const WGPUColorTargetState){
+              .format = game.surface_capabilities.formats[0],
+              .writeMask = WGPUColorWriteMask_All,
+              .blend = !translucent ? NULL : &(const WGPUBlendState){
+                .color = (WGPUBlendComponent){
+                  .srcFactor = WGPUBlendFactor_SrcAlpha,
+                  .operation = WGPUBlendOperation_Add,
+                  .dstFactor = WGPUBlendFactor_OneMinusSrcAlpha,
+                },
+                .alpha = (WGPUBlendComponent){
+                  .srcFactor = WGPUBlendFactor_Zero,
+                  .operation = WGPUBlendOperation_Add,
+                  .dstFactor = WGPUBlendFactor_One,
+                },
+              },
+            },
           },
         },
-      },
-      .primitive = (const WGPUPrimitiveState){
-        .topology = WGPUPrimitiveTopology_TriangleList,
-        .frontFace = WGPUFrontFace_CCW,
-        .cullMode = WGPUCullMode_Back,
-      },
-      .multisample = (const WGPUMultisampleState){
-        .count = 1,
-        .mask = 0xFFFFFFFF,
-      },
-      .depthStencil = &(WGPUDepthStencilState){
-        .depthWriteEnabled = true,
-        .depthCompare = WGPUCompareFunction_LessEqual,
-        .format = WGPUTextureFormat_Depth24Plus,
-        .stencilBack = (WGPUStencilFaceState){
-          .compare = WGPUCompareFunction_Always,
-          .failOp = WGPUStencilOperation_Replace,
-          .depthFailOp = WGPUStencilOperation_Replace,
-          .passOp = WGPUStencilOperation_Replace,
+        .primitive = (const WGPUPrimitiveState){
+          .topology = WGPUPrimitiveTopology_TriangleList,
+          .frontFace = WGPUFrontFace_CCW,
+          .cullMode = WGPUCullMode_Back,
         },
-        .stencilFront = (WGPUStencilFaceState){
-          .compare = WGPUCompareFunction_Always,
-          .failOp = WGPUStencilOperation_Replace,
-          .depthFailOp = WGPUStencilOperation_Replace,
-          .passOp = WGPUStencilOperation_Replace,
+        .multisample = (const WGPUMultisampleState){
+          .count = 1,
+          .mask = 0xFFFFFFFF,
         },
-      },
-    }
-  );
+        .depthStencil = &(WGPUDepthStencilState){
+          .depthWriteEnabled = !translucent,
+          .depthCompare = WGPUCompareFunction_LessEqual,
+          .format = WGPUTextureFormat_Depth24Plus,
+          .stencilBack = (WGPUStencilFaceState){
+            .compare = WGPUCompareFunction_Always,
+            .failOp = WGPUStencilOperation_Replace,
+            .depthFailOp = WGPUStencilOperation_Replace,
+            .passOp = WGPUStencilOperation_Replace,
+          },
+          .stencilFront = (WGPUStencilFaceState){
+            .compare = WGPUCompareFunction_Always,
+            .failOp = WGPUStencilOperation_Replace,
+            .depthFailOp = WGPUStencilOperation_Replace,
+            .passOp = WGPUStencilOperation_Replace,
+          },
+        },
+      }
+    );
+    assert(game.section_pipelines[pass]);
+  }
 
   game.render_pipeline_transparent = wgpuDeviceCreateRenderPipeline(
     game.device,
@@ -1090,7 +1201,7 @@ void chunk_renderer_init() {
       },
     }
   );
-  assert(game.render_pipeline);
+  assert(game.render_pipeline_transparent);
 
   game.config = (const WGPUSurfaceConfiguration){
     .device = game.device,
@@ -1112,6 +1223,38 @@ void chunk_renderer_init() {
   };
 }
 
+typedef struct TranslucentSection {
+  ChunkSection *section;
+  float distance2;
+} TranslucentSection;
+
+// Grows with the world's chunk slots
+static TranslucentSection *translucent_sections = NULL;
+static int translucent_capacity = 0;
+
+static int compare_translucent_sections(const void *a, const void *b) {
+  float da = ((const TranslucentSection *)a)->distance2;
+  float db = ((const TranslucentSection *)b)->distance2;
+  return (da < db) - (da > db);
+}
+
+static int section_pass_quads(ChunkSection *section, MeshPass pass) {
+  if (section->num_quads == 0) {
+    return 0;
+  }
+  return section->mesh.groups[PASS_GROUP(pass + 1, 0)] - section->mesh.groups[PASS_GROUP(pass, 0)];
+}
+
+static void draw_section_pass(WGPURenderPassEncoder render_pass_encoder, ChunkSection *section, MeshPass pass) {
+  int count = section_pass_quads(section, pass);
+  if (count == 0) {
+    return;
+  }
+  wgpuRenderPassEncoderSetBindGroup(render_pass_encoder, 1, quad_arena_bind_group(game.quad_arena, section->quad_range), 1, &section->quad_range.offset);
+  // The shader reads the quads by instance index, so the pass starts at its first quad
+  wgpuRenderPassEncoderDrawIndexed(render_pass_encoder, 6, count, 0, 0, section->mesh.groups[PASS_GROUP(pass, 0)]);
+}
+
 void chunk_renderer_render(WGPURenderPassEncoder render_pass_encoder) {
   // Interpolate between last and current position for smooth movement
   vec3 position;
@@ -1152,22 +1295,38 @@ void chunk_renderer_render(WGPURenderPassEncoder render_pass_encoder) {
 
   wgpuRenderPassEncoderSetIndexBuffer(render_pass_encoder, game.index_buffer, WGPUIndexFormat_Uint32, 0, WGPU_WHOLE_SIZE);
   wgpuRenderPassEncoderSetBindGroup(render_pass_encoder, 0, game.bind_group, 0, NULL);
-  wgpuRenderPassEncoderSetPipeline(render_pass_encoder, game.render_pipeline);
 
-  for (int ci = 0; ci < MAX_CHUNKS; ci += 1) {
-    Chunk *chunk = game.world.chunks[ci];
-    if (chunk == NULL) {
-      continue;
-    }
-    for (int s = 0; s < 24; s += 1) {
-      if (chunk->sections[s].num_quads == 0) {
+  // Opaque quads go first so the cutout ones behind them fail the depth test early
+  int num_translucent = 0;
+  if (translucent_capacity < game.world.chunk_slots_used * Y_SECTIONS) {
+    translucent_capacity = game.world.chunk_capacity * Y_SECTIONS;
+    translucent_sections = realloc(translucent_sections, translucent_capacity * sizeof(TranslucentSection));
+  }
+  for (int pass = MESH_PASS_OPAQUE; pass < MESH_PASS_TRANSLUCENT; pass++) {
+    wgpuRenderPassEncoderSetPipeline(render_pass_encoder, game.section_pipelines[pass]);
+    for (int ci = 0; ci < game.world.chunk_slots_used; ci += 1) {
+      Chunk *chunk = game.world.chunks[ci];
+      if (chunk == NULL) {
         continue;
       }
-      wgpuRenderPassEncoderSetVertexBuffer(render_pass_encoder, 0, chunk->sections[s].vertex_buffer, 0, WGPU_WHOLE_SIZE);
-      wgpuRenderPassEncoderDrawIndexed(render_pass_encoder, chunk->sections[s].num_quads * 6, 1, 0, 0, 0);
+      for (int s = 0; s < 24; s += 1) {
+        ChunkSection *section = &chunk->sections[s];
+        draw_section_pass(render_pass_encoder, section, pass);
+        if (pass == MESH_PASS_OPAQUE && section_pass_quads(section, MESH_PASS_TRANSLUCENT) > 0) {
+          vec3 center = {section->x * CHUNK_SIZE + 8, section->y * CHUNK_SIZE + 8, section->z * CHUNK_SIZE + 8};
+          translucent_sections[num_translucent++] = (TranslucentSection){section, glm_vec3_distance2(center, eye)};
+        }
+      }
     }
   }
 
+  // Translucent quads are blended, so the sections furthest away are drawn first
+  qsort(translucent_sections, num_translucent, sizeof(TranslucentSection), compare_translucent_sections);
+  wgpuRenderPassEncoderSetPipeline(render_pass_encoder, game.section_pipelines[MESH_PASS_TRANSLUCENT]);
+  for (int i = 0; i < num_translucent; i++) {
+    draw_section_pass(render_pass_encoder, translucent_sections[i].section, MESH_PASS_TRANSLUCENT);
+  }
+
   // Draw blocks breaking
   wgpuRenderPassEncoderSetPipeline(render_pass_encoder, game.render_pipeline_transparent);
   wgpuRenderPassEncoderSetVertexBuffer(render_pass_encoder, 0, game.block_overlay_vertex_buffer, 0, WGPU_WHOLE_SIZE);
@@ -1580,6 +1739,7 @@ void block_selected_renderer_render(WGPURenderPassEncoder render_pass_encoder) {
   wgpuRenderPassEncoderDraw(render_pass_encoder, 18 * 4 * 2, 1, 0, 0);
 }
 
+
 void entity_renderer_init() {
   game.entity_renderer.shader_module =
     frmwrk_load_shader_module(game.device, "entity.wgsl");
@@ -1643,15 +1803,7 @@ void entity_renderer_init() {
     }
   );
 
-  game.entity_renderer.instance_buffer = frmwrk_device_create_buffer_init(
-    game.device,
-    &(const frmwrk_buffer_init_descriptor){
-      .label = "Entity Instance Buffer",
-      .content = game.entity_renderer.instance_data,
-      .content_size = sizeof(game.entity_renderer.instance_data),
-      .usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst,
-    }
-  );
+  entity_renderer_create_instance_buffer(WORLD_MIN_ENTITIES);
 
   WGPUBindGroupLayoutDescriptor bgl_desc = {
     .entryCount = 1,
@@ -2049,7 +2201,7 @@ void update_block_breaking_stages() {
     pos[0] = game.block_breaking_position[0];
     pos[1] = game.block_breaking_position[1];
     pos[2] = game.block_breaking_position[2];
-    world_set_block(&game.world, pos, 0, game.block_info, game.biome_info, game.device);
+    world_set_block(&game.world, pos, 0);
     mcapi_send_player_action(game.conn, (mcapiPlayerActionPacket){
                                           .face = game.block_breaking_face,
                                           .position = {game.block_breaking_position[0], game.block_breaking_position[1], game.block_breaking_position[2]},
@@ -2132,6 +2284,10 @@ int main(int argc, char *argv[]) {
   init_mcapi(server_ip, port, uuid, access_token, username);
   frmwrk_setup_logging(WGPULogLevel_Warn);
   load_blocks(game.block_info, &game.texture_sheet);
+  chunk_build_block_flags(game.block_info, MAX_BLOCKS);
+  chunk_build_texture_passes(&game.texture_sheet);
+  game.mesh_pool = mesh_pool_create(0, game.block_info);
+  game.world.chunk_pool = chunk_pool_create(CHUNK_POOL_SLAB_CHUNKS, true);
   save_image("texture_sheet.png", game.texture_sheet.data, TEXTURE_SIZE * TEXTURE_TILES, TEXTURE_SIZE * TEXTURE_TILES);
   entity_register_entities(game.entity_info, &game.entity_sheet);
   save_image("entity_sheet.png", game.entity_sheet.data, ENTITY_SHEET_X, ENTITY_SHEET_Y);
@@ -2160,12 +2316,19 @@ int main(int argc, char *argv[]) {
 
   game.last_render_time = glfwGetTime();
   game.target_render_time = 1.0 / 60.0;
+  game.remesh_budget = 0.004;
 
   game.last_tick_time = glfwGetTime();
   game.target_tick_time = 1.0 / TICKS_PER_SECOND;
 
   while (!glfwWindowShouldClose(game.window)) {
     mcapi_poll(game.conn);
+    world_process_dirty(&game.world, game.mesh_pool, game.block_info, game.remesh_budget);
+    world_upload_finished_meshes(&game.world, game.mesh_pool);
+    // Compact only once nothing is waiting to be meshed, a few sections a frame
+    if (game.world.num_dirty_sections == 0 && game.world.num_pending_chunks == 0) {
+      world_compact_meshes(&game.world, game.quad_arena, game.remesh_budget);
+    }
     glfwPollEvents();
 
     game.current_time = glfwGetTime();
@@ -2283,14 +2446,18 @@ int main(int argc, char *argv[]) {
     wgpuTextureRelease(surface_texture.texture);
   }
 
-  // Free chunks
-  for (int i = 0; i < MAX_CHUNKS; i++) {
-    if (game.world.chunks[i] != NULL) {
-      chunk_destroy(game.world.chunks[i]);
-    }
-  }
+  mesh_pool_destroy(game.mesh_pool);
 
-  wgpuRenderPipelineRelease(game.render_pipeline);
+  // Free chunks and entities
+  world_destroy(&game.world);
+  // The sections have given their ranges back by now
+  quad_arena_destroy(game.quad_arena);
+  chunk_pool_destroy(game.world.chunk_pool);
+  free(translucent_sections);
+
+  for (int pass = 0; pass < MESH_PASSES; pass++) {
+    wgpuRenderPipelineRelease(game.section_pipelines[pass]);
+  }
   wgpuPipelineLayoutRelease(game.pipeline_layout);
   wgpuShaderModuleRelease(game.shader_module);
   wgpuSurfaceCapabilitiesFreeMembers(game.surface_capabilities);
@@ -2299,6 +2466,7 @@ int main(int argc, char *argv[]) {
   wgpuAdapterRelease(game.adapter);
   wgpuSurfaceRelease(game.surface);
   wgpuBufferRelease(game.uniform_buffer);
+  wgpuBufferRelease(game.tint_buffer);
   glfwDestroyWindow(game.window);
   wgpuInstanceRelease(game.instance);
   glfwTerminate();
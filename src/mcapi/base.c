@@ -13,6 +13,7 @@
 #include <unistd.h>
 
 #include "base.h"
+#include "capture.h"
 
 #include "../datatypes.h"
 #include "../logging.h"
@@ -28,6 +29,17 @@ void dummy_compression_cb(mcapiConnection * UNUSED(c), mcapiSetCompressionPacket
 
 void dummy_encryption_cb(mcapiConnection * UNUSED(c), mcapiEncryptionRequestPacket * UNUSED(p)) {}
 
+static mcapiConnection *alloc_connection() {
+  mcapiConnection *conn = calloc(1, sizeof(mcapiConnection));
+  conn->compressor = libdeflate_alloc_compressor(6);
+  conn->decompressor = libdeflate_alloc_decompressor();
+
+  // Register compression and encryption to a fake callback in order to register the parsing code
+  mcapi_set_set_compression_cb(conn, dummy_compression_cb);
+  mcapi_set_encryption_request_cb(conn, dummy_encryption_cb);
+  return conn;
+}
+
 mcapiConnection *mcapi_create_connection(char *hostname, short port, char *uuid, char *access_token) {
   char protoname[] = "tcp";
   struct protoent *protoent;
@@ -79,29 +91,38 @@ mcapiConnection *mcapi_create_connection(char *hostname, short port, char *uuid,
   ERR_load_crypto_strings();
   // OPENSSL_config(NULL);
 
-  mcapiConnection *conn = calloc(1, sizeof(mcapiConnection));
+  mcapiConnection *conn = alloc_connection();
   conn->access_token = access_token;
   conn->uuid = uuid;
 
   conn->sockfd = sockfd;
 
-  conn->compressor = libdeflate_alloc_compressor(6);
-  conn->decompressor = libdeflate_alloc_decompressor();
-
   INFO("Connected to %s:%d", hostname, port);
 
-  // Register compression and encryption to a fake callback in order to register the parsing code
-  mcapi_set_set_compression_cb(conn, dummy_compression_cb);
-  mcapi_set_encryption_request_cb(conn, dummy_encryption_cb);
+  return conn;
+}
 
+mcapiConnection *mcapi_create_replay_connection(const char *filename, double speed) {
+  mcapiReplay *replay = mcapi_replay_create(filename, speed);
+  if (replay == NULL) {
+    return NULL;
+  }
+  mcapiConnection *conn = alloc_connection();
+  conn->sockfd = -1;
+  conn->replay = replay;
   return conn;
 }
 
 void mcapi_destroy_connection(mcapiConnection *conn) {
+  mcapi_stop_capture(conn);
   libdeflate_free_compressor(conn->compressor);
   libdeflate_free_decompressor(conn->decompressor);
 
-  close(conn->sockfd);
+  if (conn->replay != NULL) {
+    mcapi_replay_destroy(conn->replay);
+  } else {
+    close(conn->sockfd);
+  }
 
   EVP_cleanup();
   CRYPTO_cleanup_all_ex_data();
@@ -116,6 +137,19 @@ mcapiConnState mcapi_get_state(mcapiConnection *conn) {
   return conn->state;
 }
 
+bool mcapi_start_capture(mcapiConnection *conn, const char *filename) {
+  mcapi_stop_capture(conn);
+  conn->capture = mcapi_capture_create(filename);
+  return conn->capture != NULL;
+}
+
+void mcapi_stop_capture(mcapiConnection *conn) {
+  if (conn->capture != NULL) {
+    mcapi_capture_destroy(conn->capture);
+    conn->capture = NULL;
+  }
+}
+
 #define READABLE_BUF_SIZE 1024 * 8
 
 uint8_t _internal_readable_buffer[READABLE_BUF_SIZE];
@@ -261,9 +295,84 @@ void enable_encryption(mcapiConnection *conn, mcapiEncryptionRequestPacket *encr
   conn->encryption_enabled = true;
 }
 
+// Parses a finished packet and hands it to the callback registered for the current state
+static void dispatch_packet(mcapiConnection *conn, ReadableBuffer *data) {
+  int type = read_varint(data);
+  // printf("Handling packet %02x (len %ld)\n", type, data->buf.len);
+  // mcapi_print_buf(data->buf);
+  if (conn->state == MCAPI_STATE_LOGIN) {
+    if (type == PTYPE_LOGIN_CB_LOGIN_COMPRESSION) {
+      INFO("Enabling compression");
+      mcapiSetCompressionPacket* compression = (mcapiSetCompressionPacket *)PACKET_FUNCTIONS.login_create_funcs[PTYPE_LOGIN_CB_LOGIN_COMPRESSION](data);
+      conn->compression_threshold = compression->threshold;
+      PACKET_FUNCTIONS.login_destroy_funcs[PTYPE_LOGIN_CB_LOGIN_COMPRESSION]((mcapiPacket*)compression);
+    } else if (type == PTYPE_LOGIN_CB_HELLO) {
+      INFO("Enabling encryption");
+      mcapiEncryptionRequestPacket* encrypt_req = (mcapiEncryptionRequestPacket *)PACKET_FUNCTIONS.login_create_funcs[PTYPE_LOGIN_CB_HELLO](data);
+      // A replay has nothing to encrypt, and mustn't log in to the session server
+      if (conn->replay == NULL) {
+        enable_encryption(conn, encrypt_req);
+      }
+      PACKET_FUNCTIONS.login_destroy_funcs[PTYPE_LOGIN_CB_HELLO]((mcapiPacket*)encrypt_req);
+    }
+    if (conn->login_cbs[type]) {
+      if (PACKET_FUNCTIONS.login_create_funcs[type]) {
+        mcapiPacket* packet = PACKET_FUNCTIONS.login_create_funcs[type](data);
+        conn->login_cbs[type](conn, packet);
+        PACKET_FUNCTIONS.login_destroy_funcs[type](packet);
+      } else {
+        conn->login_cbs[type](conn, NULL);
+      }
+    } else {
+      WARN("Unknown login packet %02x (len %ld)", type, data->buf.len);
+    }
+  } else if (conn->state == MCAPI_STATE_CONFIG) {
+    if (conn->config_cbs[type]) {
+      if (PACKET_FUNCTIONS.config_create_funcs[type]) {
+        mcapiPacket* packet = PACKET_FUNCTIONS.config_create_funcs[type](data);
+        conn->config_cbs[type](conn, packet);
+        PACKET_FUNCTIONS.config_destroy_funcs[type](packet);
+      } else {
+        conn->config_cbs[type](conn, NULL);
+      }
+    } else {
+      WARN("Unknown config packet %02x (len %ld)", type, data->buf.len);
+    }
+  } else if (conn->state == MCAPI_STATE_PLAY) {
+    if (conn->play_cbs[type]) {
+      if (PACKET_FUNCTIONS.play_create_funcs[type]) {
+        mcapiPacket* packet = PACKET_FUNCTIONS.play_create_funcs[type](data);
+        conn->play_cbs[type](conn, packet);
+        PACKET_FUNCTIONS.play_destroy_funcs[type](packet);
+      } else {
+        conn->play_cbs[type](conn, NULL);
+      }
+    } else {
+      // WARN("Unknown play packet %02x (len %ld)", type, data->buf.len);
+    }
+  }
+}
+
+// Hands out the captured packets that are due, in the state they were received in
+static void replay_poll(mcapiConnection *conn) {
+  mcapiCaptureRecord record;
+  Buffer packet;
+  while (mcapi_replay_next(conn->replay, &record, &packet)) {
+    conn->state = record.state;
+    ReadableBuffer data = to_readable_buffer(packet);
+    dispatch_packet(conn, &data);
+    destroy_buffer(packet);
+  }
+}
+
 void mcapi_poll(mcapiConnection *conn) {
   static ReadableBuffer curr_packet = {};
 
+  if (conn->replay != NULL) {
+    replay_poll(conn);
+    return;
+  }
+
   int nbytes_read;
 
   while ((nbytes_read = read(conn->sockfd, readable.buf.ptr, BUFSIZ)) > 0) {
@@ -313,60 +422,13 @@ void mcapi_poll(mcapiConnection *conn) {
           }
         }
 
-        // Handle packet
-
-        int type = read_varint(&curr_packet);
-        // printf("Handling packet %02x (len %ld)\n", type, curr_packet.buf.len);
-        // mcapi_print_buf(curr_packet.buf);
-        if (conn->state == MCAPI_STATE_LOGIN) {
-          if (type == PTYPE_LOGIN_CB_LOGIN_COMPRESSION) {
-            INFO("Enabling compression");
-            mcapiSetCompressionPacket* compression = (mcapiSetCompressionPacket *)PACKET_FUNCTIONS.login_create_funcs[PTYPE_LOGIN_CB_LOGIN_COMPRESSION](&curr_packet);
-            conn->compression_threshold = compression->threshold;
-            PACKET_FUNCTIONS.login_destroy_funcs[PTYPE_LOGIN_CB_LOGIN_COMPRESSION]((mcapiPacket*)compression);
-          } else if (type == PTYPE_LOGIN_CB_HELLO) {
-            INFO("Enabling encryption");
-            mcapiEncryptionRequestPacket* encrypt_req = (mcapiEncryptionRequestPacket *)PACKET_FUNCTIONS.login_create_funcs[PTYPE_LOGIN_CB_HELLO](&curr_packet);
-            enable_encryption(conn, encrypt_req);
-            PACKET_FUNCTIONS.login_destroy_funcs[PTYPE_LOGIN_CB_HELLO]((mcapiPacket*)encrypt_req);
-          }
-          if (conn->login_cbs[type]) {
-            if (PACKET_FUNCTIONS.login_create_funcs[type]) {
-              mcapiPacket* packet = PACKET_FUNCTIONS.login_create_funcs[type](&curr_packet);
-              conn->login_cbs[type](conn, packet);
-              PACKET_FUNCTIONS.login_destroy_funcs[type](packet);
-            } else {
-              conn->login_cbs[type](conn, NULL);
-            }
-          } else {
-            WARN("Unknown login packet %02x (len %ld)", type, curr_packet.buf.len);
-          }
-        } else if (conn->state == MCAPI_STATE_CONFIG) {
-          if (conn->config_cbs[type]) {
-            if (PACKET_FUNCTIONS.config_create_funcs[type]) {
-              mcapiPacket* packet = PACKET_FUNCTIONS.config_create_funcs[type](&curr_packet);
-              conn->config_cbs[type](conn, packet);
-              PACKET_FUNCTIONS.config_destroy_funcs[type](packet);
-            } else {
-              conn->config_cbs[type](conn, NULL);
-            }
-          } else {
-            WARN("Unknown config packet %02x (len %ld)", type, curr_packet.buf.len);
-          }
-        } else if (conn->state == MCAPI_STATE_PLAY) {
-          if (conn->play_cbs[type]) {
-            if (PACKET_FUNCTIONS.play_create_funcs[type]) {
-              mcapiPacket* packet = PACKET_FUNCTIONS.play_create_funcs[type](&curr_packet);
-              conn->play_cbs[type](conn, packet);
-              PACKET_FUNCTIONS.play_destroy_funcs[type](packet);
-            } else {
-              conn->play_cbs[type](conn, NULL);
-            }
-          } else {
-            // WARN("Unknown play packet %02x (len %ld)", type, curr_packet.buf.len);
-          }
+        if (conn->capture != NULL) {
+          Buffer payload = {.ptr = curr_packet.buf.ptr + curr_packet.cursor, .len = curr_packet.buf.len - curr_packet.cursor};
+          mcapi_capture_packet(conn->capture, MCAPI_CAPTURE_INBOUND, conn->state, payload);
         }
 
+        dispatch_packet(conn, &curr_packet);
+
         destroy_buffer(curr_packet.buf);
         curr_packet = (ReadableBuffer){0};
       }
@@ -11,9 +11,16 @@ typedef enum mcapiConnState { MCAPI_STATE_INIT = 0,
 typedef struct mcapiConnection mcapiConnection;
 
 mcapiConnection* mcapi_create_connection(char* hostname, short port, char* uuid, char* access_token);
+// Feeds the inbound packets of a capture to the callbacks instead of reading a socket, sent packets are dropped.
+// speed 1 keeps the recorded pace and 0 replays as fast as possible. Returns NULL if filename isn't a capture.
+mcapiConnection* mcapi_create_replay_connection(const char* filename, double speed);
 void mcapi_destroy_connection(mcapiConnection* conn);
 
 void mcapi_set_state(mcapiConnection* conn, mcapiConnState state);
 mcapiConnState mcapi_get_state(mcapiConnection* conn);
 
 void mcapi_poll(mcapiConnection* conn);
+
+// Appends every packet sent or received from now on to filename, returns false if it can't be opened
+bool mcapi_start_capture(mcapiConnection* conn, const char* filename);
+void mcapi_stop_capture(mcapiConnection* conn);
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 199309L
+#include "capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../logging.h"
+#include "protocol.h"
+
+static_assert(sizeof(mcapiCaptureRecord) == 24, "capture records are read back as raw bytes");
+
+static uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Copies into the ring at the running byte count `at`, wrapping around the end
+static void ring_write(mcapiCapture *capture, size_t at, const void *src, size_t len) {
+  size_t offset = at % CAPTURE_RING_BYTES;
+  size_t first = len < CAPTURE_RING_BYTES - offset ? len : CAPTURE_RING_BYTES - offset;
+  memcpy(capture->ring + offset, src, first);
+  memcpy(capture->ring, (const uint8_t *)src + first, len - first);
+}
+
+static void *capture_writer_run(void *arg) {
+  mcapiCapture *capture = arg;
+  pthread_mutex_lock(&capture->lock);
+  while (true) {
+    while (capture->head == capture->tail && !capture->stopping) {
+      pthread_cond_wait(&capture->has_data, &capture->lock);
+    }
+    if (capture->head == capture->tail) {
+      break;
+    }
+    size_t head = capture->head;
+    size_t tail = capture->tail;
+    pthread_mutex_unlock(&capture->lock);
+
+    // The producer only writes past head, so the queued bytes can be written without the lock
+    size_t offset = tail % CAPTURE_RING_BYTES;
+    size_t len = head - tail;
+    size_t first = len < CAPTURE_RING_BYTES - offset ? len : CAPTURE_RING_BYTES - offset;
+    fwrite(capture->ring + offset, 1, first, capture->file);
+    fwrite(capture->ring, 1, len - first, capture->file);
+
+    pthread_mutex_lock(&capture->lock);
+    capture->tail = head;
+  }
+  pthread_mutex_unlock(&capture->lock);
+  return NULL;
+}
+
+mcapiCapture *mcapi_capture_create(const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL) {
+    WARN("Couldn't open capture file %s", filename);
+    return NULL;
+  }
+  fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, file);
+
+  mcapiCapture *capture = calloc(1, sizeof(mcapiCapture));
+  capture->file = file;
+  capture->start_ns = now_ns();
+  capture->ring = malloc(CAPTURE_RING_BYTES);
+  pthread_mutex_init(&capture->lock, NULL);
+  pthread_cond_init(&capture->has_data, NULL);
+  if (pthread_create(&capture->writer, NULL, capture_writer_run, capture) != 0) {
+    FATAL("Couldn't start the capture writer");
+    exit(1);
+  }
+  INFO("Capturing packets to %s", filename);
+  return capture;
+}
+
+void mcapi_capture_destroy(mcapiCapture *capture) {
+  pthread_mutex_lock(&capture->lock);
+  capture->stopping = true;
+  pthread_cond_signal(&capture->has_data);
+  pthread_mutex_unlock(&capture->lock);
+  pthread_join(capture->writer, NULL);
+
+  INFO("Captured %ld packets, dropped %ld", capture->written, capture->dropped);
+  fclose(capture->file);
+  pthread_cond_destroy(&capture->has_data);
+  pthread_mutex_destroy(&capture->lock);
+  free(capture->ring);
+  free(capture);
+}
+
+void mcapi_capture_packet(mcapiCapture *capture, mcapiCaptureDirection direction, mcapiConnState state, Buffer packet) {
+  ReadableBuffer p = to_readable_buffer(packet);
+  mcapiCaptureRecord record = {
+    .time_ns = now_ns() - capture->start_ns,
+    .length = packet.len,
+    .packet_id = has_varint(p) ? read_varint(&p) : -1,
+    .direction = direction,
+    .state = state,
+  };
+  size_t len = sizeof(record) + packet.len;
+
+  pthread_mutex_lock(&capture->lock);
+  // Drop rather than wait when the writer falls behind
+  if (capture->head - capture->tail + len > CAPTURE_RING_BYTES) {
+    capture->dropped++;
+    pthread_mutex_unlock(&capture->lock);
+    return;
+  }
+  ring_write(capture, capture->head, &record, sizeof(record));
+  ring_write(capture, capture->head + sizeof(record), packet.ptr, packet.len);
+  capture->head += len;
+  capture->written++;
+  pthread_cond_signal(&capture->has_data);
+  pthread_mutex_unlock(&capture->lock);
+}
+
+// Reads the header of the next inbound record, skipping what the client sent
+static void replay_read_next(mcapiReplay *replay) {
+  while ((replay->has_next = fread(&replay->next, sizeof(replay->next), 1, replay->file) == 1)) {
+    if (replay->next.direction == MCAPI_CAPTURE_INBOUND) {
+      return;
+    }
+    fseek(replay->file, replay->next.length, SEEK_CUR);
+  }
+}
+
+mcapiReplay *mcapi_replay_create(const char *filename, double speed) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    WARN("Couldn't open capture file %s", filename);
+    return NULL;
+  }
+  char magic[CAPTURE_MAGIC_LEN];
+  if (fread(magic, 1, CAPTURE_MAGIC_LEN, file) != CAPTURE_MAGIC_LEN || memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+    WARN("%s is not a capture file", filename);
+    fclose(file);
+    return NULL;
+  }
+
+  mcapiReplay *replay = calloc(1, sizeof(mcapiReplay));
+  replay->file = file;
+  replay->speed = speed;
+  replay_read_next(replay);
+  INFO("Replaying packets from %s", filename);
+  return replay;
+}
+
+void mcapi_replay_destroy(mcapiReplay *replay) {
+  fclose(replay->file);
+  free(replay);
+}
+
+bool mcapi_replay_next(mcapiReplay *replay, mcapiCaptureRecord *record, Buffer *packet) {
+  if (!replay->has_next) {
+    return false;
+  }
+  uint64_t now = now_ns();
+  if (replay->start_ns == 0) {
+    replay->start_ns = now;
+  }
+  if (replay->speed > 0 && replay->next.time_ns > (now - replay->start_ns) * replay->speed) {
+    return false;
+  }
+
+  *record = replay->next;
+  *packet = create_buffer(record->length);
+  if (fread(packet->ptr, 1, record->length, replay->file) != record->length) {
+    WARN("Capture is cut off in the middle of a packet");
+    destroy_buffer(*packet);
+    replay->has_next = false;
+    return false;
+  }
+  replay->packets++;
+  replay_read_next(replay);
+  if (!replay->has_next) {
+    INFO("Replayed %ld packets in %.2fs", replay->packets, (now_ns() - replay->start_ns) / 1e9);
+  }
+  return true;
+}
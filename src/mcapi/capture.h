@@ -0,0 +1,75 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../datatypes.h"
+#include "base.h"
+
+// A capture file is CAPTURE_MAGIC followed by records. Every record is an
+// mcapiCaptureRecord and then `length` bytes of decompressed, decrypted packet,
+// starting with the packet id varint.
+#define CAPTURE_MAGIC "CMCCAP01"
+#define CAPTURE_MAGIC_LEN 8
+
+// Bytes of records that can wait for the writer before new packets get dropped
+#define CAPTURE_RING_BYTES (16 * 1024 * 1024)
+
+typedef enum mcapiCaptureDirection {
+  MCAPI_CAPTURE_INBOUND = 0,
+  MCAPI_CAPTURE_OUTBOUND = 1,
+} mcapiCaptureDirection;
+
+typedef struct mcapiCaptureRecord {
+  uint64_t time_ns; // Since the capture started
+  uint32_t length;
+  int32_t packet_id;
+  uint8_t direction; // mcapiCaptureDirection
+  uint8_t state; // mcapiConnState the packet was handled in
+  uint8_t reserved[6];
+} mcapiCaptureRecord;
+
+// Copies packets into a ring buffer on the network thread and writes them out
+// on a background thread, so recording never waits on the disk.
+typedef struct mcapiCapture {
+  FILE *file;
+  uint64_t start_ns;
+
+  pthread_mutex_t lock;
+  pthread_cond_t has_data;
+  bool stopping;
+  uint8_t *ring;
+  size_t head; // Total bytes ever queued
+  size_t tail; // Total bytes ever written
+  long dropped;
+  long written;
+
+  pthread_t writer;
+} mcapiCapture;
+
+// Returns NULL if the file can't be opened
+mcapiCapture *mcapi_capture_create(const char *filename);
+// Writes out everything still queued before closing the file
+void mcapi_capture_destroy(mcapiCapture *capture);
+
+// packet holds the id varint and the body
+void mcapi_capture_packet(mcapiCapture *capture, mcapiCaptureDirection direction, mcapiConnState state, Buffer packet);
+
+// Reads the inbound packets of a capture back in order, streaming them from the file
+typedef struct mcapiReplay {
+  FILE *file;
+  double speed; // 1 keeps the recorded pace, 0 hands out every packet at once
+  uint64_t start_ns; // Set when the first packet is asked for
+  bool has_next;
+  mcapiCaptureRecord next;
+  long packets;
+} mcapiReplay;
+
+// Returns NULL if the file can't be opened or isn't a capture
+mcapiReplay *mcapi_replay_create(const char *filename, double speed);
+void mcapi_replay_destroy(mcapiReplay *replay);
+
+// Returns the next inbound packet once it's due, the caller frees packet with destroy_buffer.
+// Returns false if nothing is due yet or the capture has ended.
+bool mcapi_replay_next(mcapiReplay *replay, mcapiCaptureRecord *record, Buffer *packet);
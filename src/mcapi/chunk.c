@@ -22,12 +22,19 @@ void mcapi_send_chunk_batch_received(mcapiConnection* conn, mcapiChunkBatchRecei
 // ====== Callbacks ======
 
 
-void read_light_data_from_packet(ReadableBuffer *p, uint8_t block_light_array[26][4096], uint8_t sky_light_array[26][4096]) {
+// Leaves the light arrays where they are in the packet
+static void read_light_data_from_packet(ReadableBuffer *p, mcapiLightData *light) {
   BitSet sky_light_mask = read_bitset(p);
   BitSet block_light_mask = read_bitset(p);
   BitSet empty_sky_light_mask = read_bitset(p);
   BitSet empty_block_light_mask = read_bitset(p);
 
+  *light = (mcapiLightData){0};
+  for (int i = 0; i < 24 + 2; i++) {
+    light->empty_sky_light |= (uint32_t)bitset_at(empty_sky_light_mask, i) << i;
+    light->empty_block_light |= (uint32_t)bitset_at(empty_block_light_mask, i) << i;
+  }
+
   int sky_light_array_count = read_varint(p);
   int sky_data_count = 0;
   for (int i = 0; i < 24 + 2; i++) {
@@ -35,15 +42,7 @@ void read_light_data_from_packet(ReadableBuffer *p, uint8_t block_light_array[26
       sky_data_count += 1;
       int length = read_varint(p);
       assert(length == 2048);
-      Buffer buffer = read_bytes(p, length);
-      // Expand from half-bytes to full-bytes for convenience to the client
-      for (int ind = 0; ind < 4096; ind += 1) {
-        sky_light_array[i][ind] = buffer.ptr[ind / 2] >> (4 * (ind % 2)) & 0x0F;
-      }
-    } else if (bitset_at(empty_sky_light_mask, i)) {
-      memset(sky_light_array[i], 0x0, 4096);
-    } else {
-      memset(sky_light_array[i], 0xf, 4096);
+      light->sky_light[i] = read_bytes(p, length).ptr;
     }
   }
   assert(sky_data_count == sky_light_array_count);
@@ -55,15 +54,7 @@ void read_light_data_from_packet(ReadableBuffer *p, uint8_t block_light_array[26
       block_data_count += 1;
       int length = read_varint(p);
       assert(length == 2048);
-      Buffer buffer = read_bytes(p, length);
-      // Expand from half-bytes to full-bytes for convenience to the client
-      for (int ind = 0; ind < 4096; ind += 1) {
-        block_light_array[i][ind] = buffer.ptr[ind / 2] >> (4 * (ind % 2)) & 0x0F;
-      }
-    } else if (bitset_at(empty_block_light_mask, i)) {
-      memset(block_light_array[i], 0x0, 4096);
-    } else {
-      memset(block_light_array[i], 0xf, 4096);
+      light->block_light[i] = read_bytes(p, length).ptr;
     }
   }
   assert(block_data_count == block_light_array_count);
@@ -74,15 +65,57 @@ void read_light_data_from_packet(ReadableBuffer *p, uint8_t block_light_array[26
   destroy_bitset(empty_block_light_mask);
 }
 
+static void copy_light(const uint8_t *src, bool empty, uint8_t dst[2048]) {
+  if (src != NULL) {
+    memcpy(dst, src, 2048);
+  } else {
+    memset(dst, empty ? 0x00 : 0xff, 2048);
+  }
+}
+
+void mcapi_copy_light(const mcapiLightData *light, int index, uint8_t sky_light[2048], uint8_t block_light[2048]) {
+  copy_light(light->sky_light[index], (light->empty_sky_light >> index) & 1, sky_light);
+  copy_light(light->block_light[index], (light->empty_block_light >> index) & 1, block_light);
+}
+
+void mcapi_read_palette(const mcapiPalettedData *data, int palette[]) {
+  // Varints are at most 5 bytes
+  ReadableBuffer p = {.buf = {.ptr = (uint8_t *)data->palette, .len = data->palette_len * 5}, .cursor = 0};
+  for (int i = 0; i < data->palette_len; i++) {
+    palette[i] = read_varint(&p);
+  }
+}
+
 int calc_compressed_arr_len(int entries, int bits_per_entry) {
   int entries_per_long = floor(64.0 / bits_per_entry);
   int long_count = ceil((float)entries / entries_per_long);
   return long_count;
 }
 
-MCAPI_HANDLER(play, PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT, chunk_and_light_data, mcapiChunkAndLightDataPacket, ({
-  write_buffer_to_file(p->buf, "tmp.bin");
+// Reads a paletted container without unpacking it, wider entries than max_palette_bits are ids
+static void read_paletted_data(ReadableBuffer *p, int entries, int max_palette_bits, mcapiPalettedData *out) {
+  out->bits = read_byte(p);
+  if (out->bits == 0) {
+    out->value = read_varint(p);
+    return;
+  }
+  out->direct = out->bits > max_palette_bits;
+  if (!out->direct) {
+    out->palette_len = read_varint(p);
+    out->palette = p->buf.ptr + p->cursor;
+    for (int j = 0; j < out->palette_len; j++) {
+      read_varint(p);
+    }
+    // Indices can't reach past 1 << bits, anything there is never used
+    if (out->palette_len > MCAPI_MAX_PALETTE_LEN) {
+      out->palette_len = MCAPI_MAX_PALETTE_LEN;
+    }
+  }
+  out->data = p->buf.ptr + p->cursor;
+  p->cursor += calc_compressed_arr_len(entries, out->bits) * 8;
+}
 
+MCAPI_HANDLER(play, PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT, chunk_and_light_data, mcapiChunkAndLightDataPacket, ({
   packet->chunk_x = read_int(p);
   packet->chunk_z = read_int(p);
 
@@ -105,85 +138,11 @@ MCAPI_HANDLER(play, PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT, chunk_and_light_data,
   int startp = p->cursor;
 
   packet->chunk_section_count = 24;
-  packet->chunk_sections = calloc(24, sizeof(mcapiChunkSection));
+  memset(packet->chunk_sections, 0, sizeof(packet->chunk_sections));
   for (int i = 0; i < 24; i++) {
     packet->chunk_sections[i].block_count = read_short(p);
-    {
-      uint8_t bits_per_entry = read_byte(p);
-      // DEBUG("bpe blocks = %d, ci = %d, p = %x\n", bits_per_entry, i, p->cursor);
-      if (bits_per_entry == 0) {
-        int value = read_varint(p);
-        // printf("palette_all = %d\n", value);
-
-        for (int j = 0; j < 4096; j++) {
-          packet->chunk_sections[i].blocks[j] = value;
-        }
-
-        // read_varint(p);  // Read the length of the data array (always 0)
-      } else if (bits_per_entry <= 8) {
-        int palette_len = read_varint(p);
-        int palette[palette_len];
-
-        for (int j = 0; j < palette_len; j++) {
-          palette[j] = read_varint(p);
-          // printf("palette[%d] = %d\n", j, palette[j]);
-        }
-
-        // int compressed_blocks_len = read_varint(p);
-        int compressed_blocks_len = calc_compressed_arr_len(4096, bits_per_entry);
-        // DEBUG("compressed_blocks_len %d\n", compressed_blocks_len);
-        read_compressed_long_arr(p, bits_per_entry, 4096, compressed_blocks_len, packet->chunk_sections[i].blocks);
-
-        for (int j = 0; j < 4096; j++) {
-          // if (palette[packet->chunk_sections[i].blocks[j]] == 0) {
-          packet->chunk_sections[i].blocks[j] = palette[packet->chunk_sections[i].blocks[j]];
-          // }
-        }
-
-      } else {
-        // int compressed_blocks_len = read_varint(p);
-        int compressed_blocks_len = calc_compressed_arr_len(4096, bits_per_entry);
-        // DEBUG("compressed_blocks_len no palette %d\n", compressed_blocks_len);
-        // printf("no_palette!!!!!!!!!!!!! %d %d\n", bits_per_entry, compressed_blocks_len);
-        if (compressed_blocks_len < 10) {
-          exit(1);
-        }
-
-        read_compressed_long_arr(p, bits_per_entry, 4096, compressed_blocks_len, packet->chunk_sections[i].blocks);
-      }
-    }
-
-    // Read biomes
-    {
-      uint8_t bits_per_entry = read_byte(p);
-      // DEBUG("bpe biomes = %d p = %x\n", bits_per_entry, p->cursor);
-      if (bits_per_entry == 0) {
-        int value = read_varint(p);
-        for (int j = 0; j < 64; j++) {
-          packet->chunk_sections[i].biomes[j] = value;
-        }
-      } else if (bits_per_entry <= 3) {
-        int palette_len = read_varint(p);
-        int palette[palette_len];
-
-        for (int j = 0; j < palette_len; j++) {
-          palette[j] = read_varint(p);
-        }
-
-        // int compressed_biomes_len = read_varint(p);
-        int compressed_biomes_len = calc_compressed_arr_len(64, bits_per_entry);
-
-        read_compressed_long_arr(p, bits_per_entry, 64, compressed_biomes_len, packet->chunk_sections[i].biomes);
-
-        for (int j = 0; j < 64; j++) {
-          packet->chunk_sections[i].biomes[j] = palette[packet->chunk_sections[i].biomes[j]];
-        }
-      } else {
-        // int compressed_biomes_len = read_varint(p);
-        int compressed_biomes_len = calc_compressed_arr_len(64, bits_per_entry);
-        read_compressed_long_arr(p, bits_per_entry, 64, compressed_biomes_len, packet->chunk_sections[i].biomes);
-      }
-    }
+    read_paletted_data(p, 4096, 8, &packet->chunk_sections[i].blocks);
+    read_paletted_data(p, 64, 3, &packet->chunk_sections[i].biomes);
   }
 
   // DEBUG("data_len=%d data_read=%d\n", data_len, p->cursor - startp);
@@ -206,12 +165,10 @@ MCAPI_HANDLER(play, PTYPE_PLAY_CB_LEVEL_CHUNK_WITH_LIGHT, chunk_and_light_data,
 
 
   // Sky and block lights
-  read_light_data_from_packet(p, packet->block_light_array, packet->sky_light_array);
+  read_light_data_from_packet(p, &packet->light);
 }), ({
   free(packet->heightmaps);
   packet->heightmaps = NULL;
-  free(packet->chunk_sections);
-  packet->chunk_sections = NULL;
   for (int i = 0; i < packet->block_entity_count; i++) {
     destroy_nbt(packet->block_entities[i].data);
     packet->block_entities[i].data = NULL;
@@ -224,7 +181,7 @@ MCAPI_HANDLER(play, PTYPE_PLAY_CB_LIGHT_UPDATE, update_light, mcapiUpdateLightPa
   packet->chunk_x = read_varint(p);
   packet->chunk_z = read_varint(p);
 
-  read_light_data_from_packet(p, packet->block_light_array, packet->sky_light_array);
+  read_light_data_from_packet(p, &packet->light);
 }), ({
   // No frees needed
 }))
@@ -249,3 +206,9 @@ MCAPI_HANDLER(play, PTYPE_PLAY_CB_FORGET_LEVEL_CHUNK, unload_chunk, mcapiUnloadC
 }), ({
   // No free needed
 }))
+
+MCAPI_HANDLER(play, PTYPE_PLAY_CB_SET_CHUNK_CACHE_RADIUS, chunk_cache_radius, mcapiSetChunkCacheRadiusPacket, ({
+  packet->view_distance = read_varint(p);
+}), ({
+  // No free needed
+}))
@@ -20,12 +20,42 @@ typedef struct mcapiBlockEntity {
   NBT* data;
 } mcapiBlockEntity;
 
+// Palettes on the wire use at most 8 bits per entry
+#define MCAPI_MAX_PALETTE_LEN 256
+
+// A block or biome container as it was sent. The pointers are into the packet's buffer, so they're only
+// valid in the callback, which decodes it straight into its own storage.
+typedef struct mcapiPalettedData {
+  int bits; // Bits per entry, 0 when every entry is value
+  int value;
+  bool direct; // Entries are ids rather than indices into the palette
+  int palette_len; // At most MCAPI_MAX_PALETTE_LEN
+  const uint8_t *palette; // palette_len varints, see mcapi_read_palette
+  const uint8_t *data; // Big endian longs of 64 / bits entries each
+} mcapiPalettedData;
+
 typedef struct mcapiChunkSection {
   short block_count;
-  int blocks[4096];
-  int biomes[64];
+  mcapiPalettedData blocks;
+  mcapiPalettedData biomes;
 } mcapiChunkSection;
 
+// Light for the 26 sections from the one below the world to the one above it, as it was sent
+typedef struct mcapiLightData {
+  // Two values per byte with the even index in the low nibble. Point into the packet's buffer like
+  // mcapiPalettedData, NULL when the section's light wasn't sent.
+  const uint8_t *sky_light[26];
+  const uint8_t *block_light[26];
+  // Bit per section that was sent as all dark rather than left out
+  uint32_t empty_sky_light;
+  uint32_t empty_block_light;
+} mcapiLightData;
+
+// Decodes the palette into palette, which needs room for data->palette_len values
+void mcapi_read_palette(const mcapiPalettedData *data, int palette[]);
+// Fills in the light of section index (0 is below the world). Sections left out are fully lit.
+void mcapi_copy_light(const mcapiLightData *light, int index, uint8_t sky_light[2048], uint8_t block_light[2048]);
+
 typedef struct mcapiHeightmap {
   int type;
   int data[256];
@@ -37,11 +67,10 @@ typedef struct mcapiChunkAndLightDataPacket {
   int heightmap_count;
   mcapiHeightmap *heightmaps;
   int chunk_section_count;
-  mcapiChunkSection* chunk_sections;
+  mcapiChunkSection chunk_sections[24];
   int block_entity_count;
   mcapiBlockEntity* block_entities;
-  uint8_t sky_light_array[26][4096];
-  uint8_t block_light_array[26][4096];
+  mcapiLightData light;
 } mcapiChunkAndLightDataPacket;
 
 void mcapi_set_chunk_and_light_data_cb(mcapiConnection* conn, void (*cb)(mcapiConnection*, mcapiChunkAndLightDataPacket*));
@@ -49,8 +78,7 @@ void mcapi_set_chunk_and_light_data_cb(mcapiConnection* conn, void (*cb)(mcapiCo
 typedef struct mcapiUpdateLightPacket {
   int chunk_x;
   int chunk_z;
-  uint8_t sky_light_array[26][4096];
-  uint8_t block_light_array[26][4096];
+  mcapiLightData light;
 } mcapiUpdateLightPacket;
 
 void mcapi_set_update_light_cb(mcapiConnection* conn, void (*cb)(mcapiConnection*, mcapiUpdateLightPacket*));
@@ -74,3 +102,9 @@ typedef struct mcapiUnloadChunk {
 } mcapiUnloadChunk;
 
 void mcapi_set_unload_chunk_cb(mcapiConnection* conn, void (*cb)(mcapiConnection*, mcapiUnloadChunk*));
+
+typedef struct mcapiSetChunkCacheRadiusPacket {
+  int view_distance;  // Render distance in chunks, from the server's view-distance
+} mcapiSetChunkCacheRadiusPacket;
+
+void mcapi_set_chunk_cache_radius_cb(mcapiConnection* conn, void (*cb)(mcapiConnection*, mcapiSetChunkCacheRadiusPacket*));
@@ -6,6 +6,7 @@
 #include <unistd.h>
 
 #include "base.h"
+#include "capture.h"
 #include "../datatypes.h"
 #include "protocol.h"
 #include "internal.h"
@@ -24,6 +25,13 @@ WritableBuffer reusable_buffer = {
 PacketFunctions PACKET_FUNCTIONS = { 0 };
 
 void send_packet(mcapiConnection *conn, const Buffer packet) {
+  if (conn->capture != NULL) {
+    mcapi_capture_packet(conn->capture, MCAPI_CAPTURE_OUTBOUND, conn->state, packet);
+  }
+  if (conn->replay != NULL) {
+    return;
+  }
+
   WritableBuffer header_buffer = create_writable_buffer(30);
 
   Buffer const *rest_of_packet = NULL;
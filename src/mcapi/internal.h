@@ -75,6 +75,8 @@ void send_packet(mcapiConnection *conn, const Buffer packet);
 
 
 typedef struct mcapiPacket mcapiPacket;
+typedef struct mcapiCapture mcapiCapture;
+typedef struct mcapiReplay mcapiReplay;
 
 typedef mcapiPacket * (*CreateHandler)(ReadableBuffer *p);
 typedef void (*DestroyHandler)(mcapiPacket*);
@@ -96,6 +98,11 @@ struct mcapiConnection {
   struct libdeflate_compressor *compressor;
   struct libdeflate_decompressor *decompressor;
 
+  // Records every packet when set, see capture.h
+  mcapiCapture *capture;
+  // Set for connections made by mcapi_create_replay_connection, which have no socket
+  mcapiReplay *replay;
+
   // Callbacks
   Callback login_cbs[MCAPI_LOGIN_CB_MAX_ID];
   Callback config_cbs[MCAPI_CONFIGURATION_CB_MAX_ID];
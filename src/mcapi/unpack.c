@@ -0,0 +1,201 @@
+#define _DEFAULT_SOURCE
+#include "unpack.h"
+
+#include <endian.h>
+#include <string.h>
+
+#include "../logging.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UNPACK_X86
+#endif
+
+// The vector kernels read every entry from a 32 bit window starting at the byte
+// holding its lowest bit, which fits entries of up to 25 bits. Past 15 bits the
+// arrays are rare enough (direct block ids) that the scalar path is fine.
+#define SIMD_MAX_BITS 15
+
+static inline uint64_t load_long(const uint8_t *src) {
+  uint64_t value;
+  memcpy(&value, src, sizeof(value));
+  return be64toh(value);
+}
+
+// Inlined once per bit width so the shifts, masks and entries per long are constants
+static inline __attribute__((always_inline)) void unpack_scalar_bits(const uint8_t *src, int bits, int entries, int to[]) {
+  int per_long = 64 / bits;
+  uint64_t mask = (1ull << bits) - 1;
+  int i = 0;
+  for (; i + per_long <= entries; i += per_long, src += 8) {
+    uint64_t value = load_long(src);
+    for (int j = 0; j < per_long; j++, value >>= bits) {
+      to[i + j] = value & mask;
+    }
+  }
+  if (i < entries) {
+    uint64_t value = load_long(src);
+    for (; i < entries; i++, value >>= bits) {
+      to[i] = value & mask;
+    }
+  }
+}
+
+#define UNPACK_SCALAR_CASE(b) \
+  case b: unpack_scalar_bits(src, b, entries, to); return;
+
+static void unpack_scalar(const uint8_t *src, int bits, int entries, int to[]) {
+  switch (bits) {
+    UNPACK_SCALAR_CASE(1)
+    UNPACK_SCALAR_CASE(2)
+    UNPACK_SCALAR_CASE(3)
+    UNPACK_SCALAR_CASE(4)
+    UNPACK_SCALAR_CASE(5)
+    UNPACK_SCALAR_CASE(6)
+    UNPACK_SCALAR_CASE(7)
+    UNPACK_SCALAR_CASE(8)
+    UNPACK_SCALAR_CASE(9)
+    UNPACK_SCALAR_CASE(10)
+    UNPACK_SCALAR_CASE(11)
+    UNPACK_SCALAR_CASE(12)
+    UNPACK_SCALAR_CASE(13)
+    UNPACK_SCALAR_CASE(14)
+    UNPACK_SCALAR_CASE(15)
+    default: unpack_scalar_bits(src, bits, entries, to); return;
+  }
+}
+
+#ifdef UNPACK_X86
+
+// For entry j of a long, the bytes of its 32 bit window in the big endian long (0x80
+// past the end of the long, which pshufb turns into zeros) and where the entry starts
+// in it. Entries past the end of the long get zeros too.
+static struct {
+  _Alignas(32) uint8_t shuffles[SIMD_MAX_BITS + 1][64][4];
+  _Alignas(32) uint32_t shifts[SIMD_MAX_BITS + 1][64];
+  _Alignas(32) uint32_t multipliers[SIMD_MAX_BITS + 1][64];
+} tables;
+
+static void build_tables() {
+  for (int bits = 1; bits <= SIMD_MAX_BITS; bits++) {
+    for (int j = 0; j < 64; j++) {
+      int bit = j * bits;
+      for (int t = 0; t < 4; t++) {
+        int byte = bit / 8 + t;
+        tables.shuffles[bits][j][t] = j < 64 / bits && byte < 8 ? 7 - byte : 0x80;
+      }
+      tables.shifts[bits][j] = bit % 8;
+      // SSE has no per lane shift, multiplying moves every entry up to bit 7 instead
+      tables.multipliers[bits][j] = 1u << (7 - bit % 8);
+    }
+  }
+}
+
+// Every long is broadcast to both halves and shuffled into up to 8 windows at a time.
+// Stores can run past the long's entries, the next long overwrites them.
+static inline __attribute__((always_inline, target("avx2"))) void unpack_avx2_chunks(const uint8_t *src, int bits, int chunks, int entries, int to[]) {
+  int per_long = 64 / bits;
+  __m256i mask = _mm256_set1_epi32((1 << bits) - 1);
+  __m256i shuffles[8];
+  __m256i shifts[8];
+  for (int c = 0; c < chunks; c++) {
+    shuffles[c] = _mm256_load_si256((const __m256i *)tables.shuffles[bits][c * 8]);
+    shifts[c] = _mm256_load_si256((const __m256i *)&tables.shifts[bits][c * 8]);
+  }
+  int i = 0;
+  for (; i + chunks * 8 <= entries; i += per_long, src += 8) {
+    __m256i value = _mm256_broadcastsi128_si256(_mm_loadl_epi64((const __m128i *)src));
+    for (int c = 0; c < chunks; c++) {
+      __m256i windows = _mm256_shuffle_epi8(value, shuffles[c]);
+      __m256i entry = _mm256_and_si256(_mm256_srlv_epi32(windows, shifts[c]), mask);
+      _mm256_storeu_si256((__m256i *)(to + i + c * 8), entry);
+    }
+  }
+  unpack_scalar(src, bits, entries - i, to + i);
+}
+
+__attribute__((target("avx2"))) static void unpack_avx2(const uint8_t *src, int bits, int entries, int to[]) {
+  // Entries per long are 64, 32, 21, 16, 12, 10, 9 for 1 to 7 bits and at most 8 after that
+  switch (bits) {
+    case 1: unpack_avx2_chunks(src, 1, 8, entries, to); return;
+    case 2: unpack_avx2_chunks(src, 2, 4, entries, to); return;
+    case 3: unpack_avx2_chunks(src, 3, 3, entries, to); return;
+    case 4: unpack_avx2_chunks(src, 4, 2, entries, to); return;
+    case 5: unpack_avx2_chunks(src, 5, 2, entries, to); return;
+    case 6: unpack_avx2_chunks(src, 6, 2, entries, to); return;
+    case 7: unpack_avx2_chunks(src, 7, 2, entries, to); return;
+    default:
+      if (bits <= SIMD_MAX_BITS) {
+        unpack_avx2_chunks(src, bits, 1, entries, to);
+      } else {
+        unpack_scalar(src, bits, entries, to);
+      }
+  }
+}
+
+// Same as the AVX2 kernel with 4 windows at a time
+static inline __attribute__((always_inline, target("sse4.1"))) void unpack_sse41_chunks(const uint8_t *src, int bits, int chunks, int entries, int to[]) {
+  int per_long = 64 / bits;
+  __m128i mask = _mm_set1_epi32((1 << bits) - 1);
+  __m128i shuffles[16];
+  __m128i multipliers[16];
+  for (int c = 0; c < chunks; c++) {
+    shuffles[c] = _mm_load_si128((const __m128i *)tables.shuffles[bits][c * 4]);
+    multipliers[c] = _mm_load_si128((const __m128i *)&tables.multipliers[bits][c * 4]);
+  }
+  int i = 0;
+  for (; i + chunks * 4 <= entries; i += per_long, src += 8) {
+    __m128i value = _mm_loadl_epi64((const __m128i *)src);
+    for (int c = 0; c < chunks; c++) {
+      __m128i windows = _mm_mullo_epi32(_mm_shuffle_epi8(value, shuffles[c]), multipliers[c]);
+      __m128i entry = _mm_and_si128(_mm_srli_epi32(windows, 7), mask);
+      _mm_storeu_si128((__m128i *)(to + i + c * 4), entry);
+    }
+  }
+  unpack_scalar(src, bits, entries - i, to + i);
+}
+
+__attribute__((target("sse4.1"))) static void unpack_sse41(const uint8_t *src, int bits, int entries, int to[]) {
+  switch (bits) {
+    case 1: unpack_sse41_chunks(src, 1, 16, entries, to); return;
+    case 2: unpack_sse41_chunks(src, 2, 8, entries, to); return;
+    case 3: unpack_sse41_chunks(src, 3, 6, entries, to); return;
+    case 4: unpack_sse41_chunks(src, 4, 4, entries, to); return;
+    case 5: unpack_sse41_chunks(src, 5, 3, entries, to); return;
+    case 6: unpack_sse41_chunks(src, 6, 3, entries, to); return;
+    case 7: unpack_sse41_chunks(src, 7, 3, entries, to); return;
+    case 8: unpack_sse41_chunks(src, 8, 2, entries, to); return;
+    default:
+      if (bits <= SIMD_MAX_BITS) {
+        unpack_sse41_chunks(src, bits, bits <= 12 ? 2 : 1, entries, to);
+      } else {
+        unpack_scalar(src, bits, entries, to);
+      }
+  }
+}
+
+#endif
+
+static void unpack_select(const uint8_t *src, int bits, int entries, int to[]);
+
+static void (*unpack_kernel)(const uint8_t *src, int bits, int entries, int to[]) = unpack_select;
+
+static void unpack_select(const uint8_t *src, int bits, int entries, int to[]) {
+  unpack_kernel = unpack_scalar;
+#ifdef UNPACK_X86
+  __builtin_cpu_init();
+  build_tables();
+  if (__builtin_cpu_supports("avx2")) {
+    INFO("Unpacking chunk data with AVX2");
+    unpack_kernel = unpack_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    INFO("Unpacking chunk data with SSE4.1");
+    unpack_kernel = unpack_sse41;
+  }
+#endif
+  unpack_kernel(src, bits, entries, to);
+}
+
+void unpack_longs(const uint8_t *src, int bits, int entries, int to[]) {
+  unpack_kernel(src, bits, entries, to);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// Unpacks entries from big endian longs holding 64 / bits entries each, lowest bits
+// first, like the block, biome and heightmap arrays in chunk packets. Reads exactly
+// ceil(entries / (64 / bits)) longs. Picks an AVX2 or SSE4.1 kernel the first time
+// it's called when the CPU has one.
+void unpack_longs(const uint8_t *src, int bits, int entries, int to[]);
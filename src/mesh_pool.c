@@ -0,0 +1,171 @@
+#include "mesh_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+typedef struct MeshJob {
+  unsigned int id;
+  ChunkSection section;
+  ChunkSection neighbors[3];
+  bool has_neighbor[3];
+  MeshJob *next;
+} MeshJob;
+
+static void destroy_job(MeshJob *job) {
+  chunk_section_destroy_copy(&job->section);
+  for (int d = 0; d < 3; d++) {
+    if (job->has_neighbor[d]) {
+      chunk_section_destroy_copy(&job->neighbors[d]);
+    }
+  }
+  free(job);
+}
+
+static void *mesh_worker_run(void *arg) {
+  MeshPool *pool = arg;
+  // Every worker builds into its own scratch buffer, then copies out just what was used
+  SectionMesh scratch = section_mesh_create(MAX_QUADS_PER_SECTION);
+
+  while (true) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->jobs_head == NULL && !pool->shutting_down) {
+      pthread_cond_wait(&pool->has_jobs, &pool->lock);
+    }
+    if (pool->shutting_down) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    MeshJob *job = pool->jobs_head;
+    pool->jobs_head = job->next;
+    if (pool->jobs_head == NULL) {
+      pool->jobs_tail = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    ChunkSection *neighbors[3] = {NULL, NULL, NULL};
+    for (int d = 0; d < 3; d++) {
+      if (job->has_neighbor[d]) {
+        neighbors[d] = &job->neighbors[d];
+      }
+    }
+    chunk_section_build_mesh(&job->section, neighbors, pool->block_info, &scratch);
+
+    MeshResult *result = malloc(sizeof(MeshResult));
+    result->x = job->section.x;
+    result->y = job->section.y;
+    result->z = job->section.z;
+    result->job = job->id;
+    result->mesh = (SectionMesh){0};
+    section_mesh_copy(&result->mesh, &scratch);
+    destroy_job(job);
+
+    pthread_mutex_lock(&pool->lock);
+    result->next = pool->results;
+    pool->results = result;
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  section_mesh_destroy(&scratch);
+  return NULL;
+}
+
+MeshPool *mesh_pool_create(int num_workers, BlockInfo *block_info) {
+  if (num_workers <= 0) {
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (num_workers < 1) {
+      num_workers = 1;
+    }
+  }
+
+  MeshPool *pool = calloc(1, sizeof(MeshPool));
+  pool->block_info = block_info;
+  pool->next_job = 1;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->has_jobs, NULL);
+
+  pool->num_workers = num_workers;
+  pool->workers = calloc(num_workers, sizeof(pthread_t));
+  for (int i = 0; i < num_workers; i++) {
+    if (pthread_create(&pool->workers[i], NULL, mesh_worker_run, pool) != 0) {
+      FATAL("Failed to start meshing worker %d", i);
+      exit(1);
+    }
+  }
+  INFO("Started %d meshing workers", num_workers);
+
+  return pool;
+}
+
+void mesh_pool_destroy(MeshPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutting_down = true;
+  pthread_cond_broadcast(&pool->has_jobs);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->num_workers; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+
+  while (pool->jobs_head != NULL) {
+    MeshJob *next = pool->jobs_head->next;
+    destroy_job(pool->jobs_head);
+    pool->jobs_head = next;
+  }
+  MeshResult *result = pool->results;
+  while (result != NULL) {
+    MeshResult *next = result->next;
+    mesh_result_destroy(result);
+    result = next;
+  }
+
+  pthread_cond_destroy(&pool->has_jobs);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool);
+}
+
+void mesh_pool_submit(MeshPool *pool, ChunkSection *section, ChunkSection *neighbors[3]) {
+  MeshJob *job = malloc(sizeof(MeshJob));
+  chunk_section_copy(&job->section, section);
+  for (int d = 0; d < 3; d++) {
+    job->has_neighbor[d] = neighbors[d] != NULL;
+    if (neighbors[d] != NULL) {
+      chunk_section_copy(&job->neighbors[d], neighbors[d]);
+    }
+  }
+  job->next = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  unsigned int id = pool->next_job++;
+  job->id = id;
+  if (pool->next_job == 0) {
+    pool->next_job = 1;
+  }
+  if (pool->jobs_tail != NULL) {
+    pool->jobs_tail->next = job;
+  } else {
+    pool->jobs_head = job;
+  }
+  pool->jobs_tail = job;
+  pthread_cond_signal(&pool->has_jobs);
+  pthread_mutex_unlock(&pool->lock);
+
+  // The job may already be freed by a worker here, so use the local id
+  section->mesh_job = id;
+}
+
+MeshResult *mesh_pool_take_results(MeshPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  MeshResult *results = pool->results;
+  pool->results = NULL;
+  pthread_mutex_unlock(&pool->lock);
+  return results;
+}
+
+void mesh_result_destroy(MeshResult *result) {
+  section_mesh_destroy(&result->mesh);
+  free(result);
+}
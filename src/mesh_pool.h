@@ -0,0 +1,46 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "chunk.h"
+
+typedef struct MeshJob MeshJob;
+typedef struct MeshResult MeshResult;
+
+// A finished mesh waiting for the main thread to upload it
+typedef struct MeshResult {
+  int x;
+  int y;
+  int z;
+  unsigned int job;
+  SectionMesh mesh;
+  MeshResult *next;
+} MeshResult;
+
+// Meshes sections on worker threads. Workers only ever see snapshots of the
+// sections, and only the main thread touches the GPU.
+typedef struct MeshPool {
+  BlockInfo *block_info;
+
+  pthread_mutex_t lock;
+  pthread_cond_t has_jobs;
+  bool shutting_down;
+  MeshJob *jobs_head;
+  MeshJob *jobs_tail;
+  MeshResult *results;
+  unsigned int next_job;
+
+  int num_workers;
+  pthread_t *workers;
+} MeshPool;
+
+// Pass 0 as num_workers to use one worker per core (minus the main thread)
+MeshPool *mesh_pool_create(int num_workers, BlockInfo *block_info);
+void mesh_pool_destroy(MeshPool *pool);
+
+// Snapshots the section and its neighbors and queues it for meshing. Sets section->mesh_job.
+void mesh_pool_submit(MeshPool *pool, ChunkSection *section, ChunkSection *neighbors[3]);
+
+// Takes every finished result, the caller must free them with mesh_result_destroy
+MeshResult *mesh_pool_take_results(MeshPool *pool);
+void mesh_result_destroy(MeshResult *result);
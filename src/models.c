@@ -504,6 +504,7 @@ void load_block_states(BlockInfo* block_info, BlockTextureSheet* texture_sheet,
           break;
         }
       }
+      chunk_bake_block_quads(&info);
 
       // Save the block state
       if (id != -1) {
@@ -0,0 +1,223 @@
+#define _DEFAULT_SOURCE
+#include "paletted_container.h"
+
+#include <assert.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcapi/unpack.h"
+
+static int word_count(int size, int bits) {
+  return (size * bits + 63) / 64;
+}
+
+static uint32_t read_entry(uint64_t *words, int bits, int index) {
+  int bit = index * bits;
+  return (words[bit >> 6] >> (bit & 63)) & ((1u << bits) - 1);
+}
+
+static void write_entry(uint64_t *words, int bits, int index, uint32_t entry) {
+  int bit = index * bits;
+  uint64_t mask = (uint64_t)((1u << bits) - 1) << (bit & 63);
+  words[bit >> 6] = (words[bit >> 6] & ~mask) | ((uint64_t)entry << (bit & 63));
+}
+
+// The bits per entry needed for a palette of len values
+static int index_bits(int len) {
+  int bits = 1;
+  while ((1 << bits) < len) {
+    bits *= 2;
+  }
+  return bits <= PALETTED_MAX_INDEX_BITS ? bits : PALETTED_DIRECT_BITS;
+}
+
+void paletted_init(PalettedContainer *c, int size, int value) {
+  paletted_destroy(c);
+  c->size = size;
+  c->value = value;
+}
+
+void paletted_destroy(PalettedContainer *c) {
+  free(c->palette);
+  free(c->words);
+  *c = (PalettedContainer){0};
+}
+
+void paletted_load(PalettedContainer *c, int size, int bits, const int *palette, int palette_len, const uint8_t *longs) {
+  paletted_destroy(c);
+  c->size = size;
+  if (palette != NULL && palette_len <= 1) {
+    c->value = palette_len == 1 ? palette[0] : 0;
+    return;
+  }
+  assert(bits <= (palette != NULL ? PALETTED_MAX_INDEX_BITS : PALETTED_DIRECT_BITS));
+
+  // Rounding up to a power of two is all it takes to use the network layout as is
+  c->bits = PALETTED_DIRECT_BITS;
+  if (palette != NULL) {
+    c->bits = 1;
+    while (c->bits < bits) {
+      c->bits *= 2;
+    }
+    if (palette_len > (1 << c->bits)) {
+      palette_len = 1 << c->bits;
+    }
+    // Zeroed so a stray index past palette_len reads 0 instead of garbage
+    c->palette = calloc(1 << c->bits, sizeof(int));
+    memcpy(c->palette, palette, palette_len * sizeof(int));
+    c->palette_len = palette_len;
+  }
+  int words = word_count(size, c->bits);
+  c->words = malloc(words * sizeof(uint64_t));
+
+  if (c->bits == bits) {
+    for (int i = 0; i < words; i++) {
+      uint64_t word;
+      memcpy(&word, longs + i * 8, sizeof(word));
+      c->words[i] = be64toh(word);
+    }
+    return;
+  }
+
+  // Otherwise the entries are spread out to the wider layout
+  int values[size];
+  unpack_longs(longs, bits, size, values);
+  // Entries are in memory order on little endian hosts, so they can be stored as plain bytes or shorts
+  bool little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+  if (little_endian && c->bits == 8) {
+    uint8_t *bytes = (uint8_t *)c->words;
+    for (int i = 0; i < size; i++) {
+      bytes[i] = values[i];
+    }
+  } else if (little_endian && c->bits == 16) {
+    uint16_t *shorts = (uint16_t *)c->words;
+    for (int i = 0; i < size; i++) {
+      shorts[i] = values[i];
+    }
+  } else {
+    memset(c->words, 0, words * sizeof(uint64_t));
+    for (int i = 0; i < size; i++) {
+      write_entry(c->words, c->bits, i, values[i]);
+    }
+  }
+}
+
+void paletted_copy(PalettedContainer *dst, PalettedContainer *src) {
+  paletted_destroy(dst);
+  *dst = *src;
+  if (src->palette != NULL) {
+    dst->palette = malloc((1 << src->bits) * sizeof(int));
+    memcpy(dst->palette, src->palette, src->palette_len * sizeof(int));
+  }
+  if (src->words != NULL) {
+    int bytes = word_count(src->size, src->bits) * sizeof(uint64_t);
+    dst->words = malloc(bytes);
+    memcpy(dst->words, src->words, bytes);
+  }
+}
+
+int paletted_get(PalettedContainer *c, int index) {
+  if (c->bits == 0) {
+    return c->value;
+  }
+  uint32_t entry = read_entry(c->words, c->bits, index);
+  return c->palette != NULL ? c->palette[entry] : (int)entry;
+}
+
+// Moves the entries to a wider layout, every existing entry keeps its value
+static void grow(PalettedContainer *c, int bits) {
+  uint64_t *words = calloc(word_count(c->size, bits), sizeof(uint64_t));
+  if (bits == PALETTED_DIRECT_BITS) {
+    for (int i = 0; i < c->size; i++) {
+      write_entry(words, bits, i, paletted_get(c, i));
+    }
+    free(c->palette);
+    c->palette = NULL;
+    c->palette_len = 0;
+  } else {
+    if (c->bits == 0) {
+      c->palette = malloc((1 << bits) * sizeof(int));
+      c->palette[0] = c->value;
+      c->palette_len = 1;
+    } else {
+      c->palette = realloc(c->palette, (1 << bits) * sizeof(int));
+      for (int i = 0; i < c->size; i++) {
+        write_entry(words, bits, i, read_entry(c->words, c->bits, i));
+      }
+    }
+  }
+  free(c->words);
+  c->words = words;
+  c->bits = bits;
+}
+
+void paletted_set(PalettedContainer *c, int index, int value) {
+  if (c->bits == 0 && value == c->value) {
+    return;
+  }
+  if (c->bits == PALETTED_DIRECT_BITS) {
+    assert(value >= 0 && value < (1 << PALETTED_DIRECT_BITS));
+    write_entry(c->words, c->bits, index, value);
+    return;
+  }
+
+  int entry = 0;
+  while (entry < c->palette_len && c->palette[entry] != value) {
+    entry++;
+  }
+  if (entry == c->palette_len) {
+    if (c->bits == 0 || c->palette_len == (1 << c->bits)) {
+      grow(c, index_bits(c->palette_len + (c->bits == 0 ? 2 : 1)));
+      if (c->bits == PALETTED_DIRECT_BITS) {
+        paletted_set(c, index, value);
+        return;
+      }
+    }
+    entry = c->palette_len++;
+    c->palette[entry] = value;
+  }
+  write_entry(c->words, c->bits, index, entry);
+}
+
+void paletted_unpack(PalettedContainer *c, int start, int count, int *out) {
+  if (c->bits == 0) {
+    for (int i = 0; i < count; i++) {
+      out[i] = c->value;
+    }
+    return;
+  }
+  int bits = c->bits;
+  uint32_t mask = (1u << bits) - 1;
+  int per_word = 64 / bits;
+  int i = 0;
+  while (i < count) {
+    int bit = (start + i) * bits;
+    uint64_t word = c->words[bit >> 6] >> (bit & 63);
+    int n = per_word - (bit & 63) / bits;
+    if (n > count - i) {
+      n = count - i;
+    }
+    if (c->palette != NULL) {
+      for (int k = 0; k < n; k++, word >>= bits) {
+        out[i + k] = c->palette[word & mask];
+      }
+    } else {
+      for (int k = 0; k < n; k++, word >>= bits) {
+        out[i + k] = word & mask;
+      }
+    }
+    i += n;
+  }
+}
+
+int paletted_memory(PalettedContainer *c) {
+  int bytes = 0;
+  if (c->palette != NULL) {
+    bytes += (1 << c->bits) * sizeof(int);
+  }
+  if (c->words != NULL) {
+    bytes += word_count(c->size, c->bits) * sizeof(uint64_t);
+  }
+  return bytes;
+}
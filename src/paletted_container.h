@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// The widest palette index, containers with more distinct values store them directly
+#define PALETTED_MAX_INDEX_BITS 8
+// Block states and biome ids both fit in 16 bits
+#define PALETTED_DIRECT_BITS 16
+
+// A fixed number of ints, stored as indices into a palette of the distinct values. Like the
+// network format, but bits per entry are always a power of two so an entry never crosses a word.
+// A zeroed container holds nothing, paletted_load or paletted_init must size it first.
+typedef struct PalettedContainer {
+  uint8_t bits; // 0 when every entry is value, up to PALETTED_MAX_INDEX_BITS, or PALETTED_DIRECT_BITS
+  uint16_t size; // Number of entries
+  uint16_t palette_len;
+  int value; // The only value when bits is 0
+  int *palette; // Room for 1 << bits values, NULL when bits is 0 or the values are stored directly
+  uint64_t *words;
+} PalettedContainer;
+
+// Sets every entry to value, freeing whatever the container held
+void paletted_init(PalettedContainer *c, int size, int value);
+// Takes entries packed like the network format, big endian longs of 64 / bits entries each. They're
+// indices into palette, or the values themselves when palette is NULL. Keeps the palette as it is.
+void paletted_load(PalettedContainer *c, int size, int bits, const int *palette, int palette_len, const uint8_t *longs);
+void paletted_destroy(PalettedContainer *c);
+void paletted_copy(PalettedContainer *dst, PalettedContainer *src);
+
+int paletted_get(PalettedContainer *c, int index);
+// Grows the palette and bits per entry when value is new, they only shrink when the container is rebuilt with paletted_load or paletted_init
+void paletted_set(PalettedContainer *c, int index, int value);
+// Decodes count entries starting at start into out, much faster than calling paletted_get for each
+void paletted_unpack(PalettedContainer *c, int start, int count, int *out);
+// Bytes allocated for the palette and the entries
+int paletted_memory(PalettedContainer *c);
@@ -0,0 +1,173 @@
+#include "quad_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+static uint32_t align_up(uint32_t value, uint32_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static void insert_free_span(QuadArenaPage *page, int index, QuadArenaSpan span) {
+  if (page->num_free == page->free_capacity) {
+    page->free_capacity = page->free_capacity == 0 ? 16 : page->free_capacity * 2;
+    page->free = realloc(page->free, page->free_capacity * sizeof(QuadArenaSpan));
+  }
+  memmove(&page->free[index + 1], &page->free[index], (page->num_free - index) * sizeof(QuadArenaSpan));
+  page->free[index] = span;
+  page->num_free++;
+}
+
+static void remove_free_span(QuadArenaPage *page, int index) {
+  memmove(&page->free[index], &page->free[index + 1], (page->num_free - index - 1) * sizeof(QuadArenaSpan));
+  page->num_free--;
+}
+
+static bool add_page(QuadArena *arena) {
+  if (arena->num_pages == QUAD_ARENA_MAX_PAGES) {
+    return false;
+  }
+  QuadArenaPage *page = &arena->pages[arena->num_pages];
+  *page = (QuadArenaPage){0};
+  // The binding reaches past the last range that can start in the page
+  page->buffer = wgpuDeviceCreateBuffer(
+    arena->device,
+    &(WGPUBufferDescriptor){
+      .label = "Section Quad Arena",
+      .size = QUAD_ARENA_PAGE_SIZE + arena->binding_size,
+      .usage = WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst,
+    }
+  );
+  page->bind_group = wgpuDeviceCreateBindGroup(
+    arena->device,
+    &(WGPUBindGroupDescriptor){
+      .layout = arena->layout,
+      .entryCount = 1,
+      .entries = (WGPUBindGroupEntry[]){
+        {
+          .binding = 0,
+          .buffer = page->buffer,
+          .size = arena->binding_size,
+        },
+      },
+    }
+  );
+  insert_free_span(page, 0, (QuadArenaSpan){0, QUAD_ARENA_PAGE_SIZE});
+  arena->num_pages++;
+  return true;
+}
+
+QuadArena *quad_arena_create(WGPUDevice device, WGPUBindGroupLayout layout, uint32_t binding_size) {
+  QuadArena *arena = calloc(1, sizeof(QuadArena));
+  arena->device = device;
+  arena->queue = wgpuDeviceGetQueue(device);
+  arena->layout = layout;
+  arena->binding_size = align_up(binding_size, 4);
+  return arena;
+}
+
+void quad_arena_destroy(QuadArena *arena) {
+  for (int i = 0; i < arena->num_pages; i++) {
+    wgpuBindGroupRelease(arena->pages[i].bind_group);
+    wgpuBufferRelease(arena->pages[i].buffer);
+    free(arena->pages[i].free);
+  }
+  wgpuQueueRelease(arena->queue);
+  free(arena);
+}
+
+// First fit in the pages before max_page, adding one at the end only when may_grow is set
+static bool alloc_first_fit(QuadArena *arena, uint32_t size, int max_page, bool may_grow, QuadArenaRange *range) {
+  size = align_up(size, QUAD_ARENA_ALIGNMENT);
+  if (size == 0 || size > QUAD_ARENA_PAGE_SIZE) {
+    return false;
+  }
+  // Pages that were added earlier fill up first
+  for (int p = 0; p < max_page || (may_grow && p == arena->num_pages); p++) {
+    if (p == arena->num_pages && !add_page(arena)) {
+      WARN("Section quad arena is full");
+      return false;
+    }
+    QuadArenaPage *page = &arena->pages[p];
+    for (int i = 0; i < page->num_free; i++) {
+      QuadArenaSpan *span = &page->free[i];
+      if (span->size < size) {
+        continue;
+      }
+      *range = (QuadArenaRange){.page = p, .offset = span->offset, .size = size};
+      span->offset += size;
+      span->size -= size;
+      if (span->size == 0) {
+        remove_free_span(page, i);
+      }
+      page->used += size;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool quad_arena_alloc(QuadArena *arena, uint32_t size, QuadArenaRange *range) {
+  return alloc_first_fit(arena, size, arena->num_pages, true, range);
+}
+
+bool quad_arena_alloc_below(QuadArena *arena, uint32_t size, int max_page, QuadArenaRange *range) {
+  return alloc_first_fit(arena, size, max_page < arena->num_pages ? max_page : arena->num_pages, false, range);
+}
+
+void quad_arena_free(QuadArena *arena, QuadArenaRange *range) {
+  if (range->size == 0) {
+    return;
+  }
+  QuadArenaPage *page = &arena->pages[range->page];
+  page->used -= range->size;
+
+  // Find where the range goes and merge it with the spans it touches
+  int i = 0;
+  while (i < page->num_free && page->free[i].offset < range->offset) {
+    i++;
+  }
+  bool merge_before = i > 0 && page->free[i - 1].offset + page->free[i - 1].size == range->offset;
+  bool merge_after = i < page->num_free && range->offset + range->size == page->free[i].offset;
+  if (merge_before && merge_after) {
+    page->free[i - 1].size += range->size + page->free[i].size;
+    remove_free_span(page, i);
+  } else if (merge_before) {
+    page->free[i - 1].size += range->size;
+  } else if (merge_after) {
+    page->free[i].offset = range->offset;
+    page->free[i].size += range->size;
+  } else {
+    insert_free_span(page, i, (QuadArenaSpan){range->offset, range->size});
+  }
+  *range = (QuadArenaRange){0};
+}
+
+void quad_arena_write(QuadArena *arena, QuadArenaRange range, uint32_t offset, const void *data, size_t size) {
+  wgpuQueueWriteBuffer(arena->queue, arena->pages[range.page].buffer, range.offset + offset, data, size);
+}
+
+WGPUBindGroup quad_arena_bind_group(QuadArena *arena, QuadArenaRange range) {
+  return arena->pages[range.page].bind_group;
+}
+
+bool quad_arena_fragmented(QuadArena *arena) {
+  uint64_t used = 0;
+  for (int i = 0; i < arena->num_pages; i++) {
+    used += arena->pages[i].used;
+  }
+  // Ranges can't always be packed perfectly, so ask for a bit more than one page of room
+  uint64_t needed_pages = (used + used / 8) / QUAD_ARENA_PAGE_SIZE + 1;
+  return needed_pages < (uint64_t)arena->num_pages;
+}
+
+void quad_arena_trim(QuadArena *arena) {
+  while (arena->num_pages > 0 && arena->pages[arena->num_pages - 1].used == 0) {
+    QuadArenaPage *page = &arena->pages[arena->num_pages - 1];
+    wgpuBindGroupRelease(page->bind_group);
+    wgpuBufferRelease(page->buffer);
+    free(page->free);
+    arena->num_pages--;
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wgpu.h>
+
+// Storage buffer dynamic offsets must be a multiple of minStorageBufferOffsetAlignment
+#define QUAD_ARENA_ALIGNMENT 256
+#define QUAD_ARENA_PAGE_SIZE (16 * 1024 * 1024)
+#define QUAD_ARENA_MAX_PAGES 64
+
+// A part of one of the arena's buffers, size is 0 when nothing is allocated
+typedef struct QuadArenaRange {
+  int page;
+  uint32_t offset; // In bytes, aligned to QUAD_ARENA_ALIGNMENT
+  uint32_t size; // In bytes
+} QuadArenaRange;
+
+typedef struct QuadArenaSpan {
+  uint32_t offset;
+  uint32_t size;
+} QuadArenaSpan;
+
+typedef struct QuadArenaPage {
+  WGPUBuffer buffer;
+  WGPUBindGroup bind_group; // Bound with the range's offset as the dynamic offset
+  QuadArenaSpan *free; // Sorted by offset, touching spans are always merged
+  int num_free;
+  int free_capacity;
+  uint32_t used;
+} QuadArenaPage;
+
+// Hands out ranges of a few large storage buffers to the section meshes, so
+// remeshing doesn't create and destroy a buffer every time
+typedef struct QuadArena {
+  WGPUDevice device;
+  WGPUQueue queue;
+  WGPUBindGroupLayout layout;
+  uint32_t binding_size; // Bytes visible to the shader from a range's offset
+  QuadArenaPage pages[QUAD_ARENA_MAX_PAGES];
+  int num_pages;
+} QuadArena;
+
+// layout must have a single read only storage buffer entry with a dynamic offset
+QuadArena *quad_arena_create(WGPUDevice device, WGPUBindGroupLayout layout, uint32_t binding_size);
+void quad_arena_destroy(QuadArena *arena);
+
+// Returns false if the arena is out of pages
+bool quad_arena_alloc(QuadArena *arena, uint32_t size, QuadArenaRange *range);
+// Like quad_arena_alloc, but only in the pages before max_page and never adds one
+bool quad_arena_alloc_below(QuadArena *arena, uint32_t size, int max_page, QuadArenaRange *range);
+void quad_arena_free(QuadArena *arena, QuadArenaRange *range);
+// Writes data at offset bytes into the range, ordered with the queue's submissions
+void quad_arena_write(QuadArena *arena, QuadArenaRange range, uint32_t offset, const void *data, size_t size);
+WGPUBindGroup quad_arena_bind_group(QuadArena *arena, QuadArenaRange range);
+
+// True when compacting the ranges would free at least one page
+bool quad_arena_fragmented(QuadArena *arena);
+// Releases the pages at the end that nothing is allocated in
+void quad_arena_trim(QuadArena *arena);
@@ -1,275 +1,718 @@
 #include "world.h"
 
+#include <limits.h>
+#include <time.h>
+
 #include "logging.h"
 
-int positive_mod(int a, int b) {
-  int result = a % b;
-  if (result < 0) {
-    result += b;
+// The smallest power of two capacity that holds count, and at least min
+static int round_capacity(int count, int min) {
+  int capacity = min;
+  while (capacity < count) {
+    capacity *= 2;
   }
-  return result;
+  return capacity;
 }
 
-Chunk *world_chunk(World *world, int x, int z) {
-  for (int i = 0; i < MAX_CHUNKS; i += 1) {
-    if (world->chunks[i] == NULL) {
-      continue;
-    }
-    Chunk *chunk = world->chunks[i];
+static uint32_t chunk_hash(World *world, int x, int z) {
+  uint32_t h = (uint32_t)x * 0x9E3779B1u ^ (uint32_t)z * 0x85EBCA77u;
+  return (h ^ (h >> 15)) & (2 * world->chunk_capacity - 1);
+}
+
+// The table entry holding the chunk at x, z, or the empty entry it would go in
+static uint32_t chunk_table_find(World *world, int x, int z) {
+  uint32_t i = chunk_hash(world, x, z);
+  while (world->chunk_table[i] != 0) {
+    Chunk *chunk = world->chunks[world->chunk_table[i] - 1];
     if (chunk->x == x && chunk->z == z) {
-      return chunk;
+      break;
     }
+    i = (i + 1) & (2 * world->chunk_capacity - 1);
   }
-  return NULL;
+  return i;
 }
 
-int world_add_chunk(World *world, Chunk *chunk) {
-  for (int i = 0; i < MAX_CHUNKS; i += 1) {
-    if (world->chunks[i] != NULL && world->chunks[i]->x == chunk->x && world->chunks[i]->z == chunk->z) {
-      chunk_destroy(world->chunks[i]);
-      world->chunks[i] = chunk;
-      return i;
+// Empties entry i, moving later entries of the probe sequence back so lookups don't stop at the hole
+static void chunk_table_remove(World *world, uint32_t i) {
+  uint32_t mask = 2 * world->chunk_capacity - 1;
+  for (uint32_t j = (i + 1) & mask; world->chunk_table[j] != 0; j = (j + 1) & mask) {
+    Chunk *chunk = world->chunks[world->chunk_table[j] - 1];
+    uint32_t home = chunk_hash(world, chunk->x, chunk->z);
+    // The entry can only move back if the hole isn't in between its home and where it is
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      world->chunk_table[i] = world->chunk_table[j];
+      i = j;
     }
   }
+  world->chunk_table[i] = 0;
+}
 
-  for (int i = 0; i < MAX_CHUNKS; i += 1) {
-    if (world->chunks[i] == NULL) {
-      world->chunks[i] = chunk;
-      return i;
+// Moves the chunks to the first slots of capacity new ones and rebuilds the table around them
+static void resize_chunks(World *world, int capacity) {
+  Chunk **chunks = calloc(capacity, sizeof(Chunk *));
+  int count = 0;
+  for (int i = 0; i < world->chunk_slots_used; i++) {
+    if (world->chunks[i] != NULL) {
+      chunks[count++] = world->chunks[i];
     }
   }
+  free(world->chunks);
+  free(world->chunk_table);
+  world->chunks = chunks;
+  world->chunk_capacity = capacity;
+  world->chunk_table = calloc(2 * capacity, sizeof(uint32_t));
+  world->chunk_slots_used = count;
+  world->free_chunk_slots = realloc(world->free_chunk_slots, capacity * sizeof(int));
+  world->num_free_chunk_slots = 0;
+  for (int slot = 0; slot < count; slot++) {
+    world->chunk_table[chunk_table_find(world, chunks[slot]->x, chunks[slot]->z)] = slot + 1;
+  }
+}
+
+void world_reserve_chunks(World *world, int count) {
+  int capacity = round_capacity(count > world->chunk_count ? count : world->chunk_count, WORLD_MIN_CHUNKS);
+  if (capacity != world->chunk_capacity) {
+    INFO("Resizing the world from %d to %d chunk slots", world->chunk_capacity, capacity);
+    resize_chunks(world, capacity);
+  }
+}
+
+Chunk *world_chunk(World *world, int x, int z) {
+  if (world->chunk_count == 0) {
+    return NULL;
+  }
+  uint32_t entry = world->chunk_table[chunk_table_find(world, x, z)];
+  return entry == 0 ? NULL : world->chunks[entry - 1];
+}
+
+// Sets the readiness bits of chunk and of the +x and +z chunks, which mesh against it
+static void link_neighbors(World *world, Chunk *chunk) {
+  chunk->loaded_neighbors = 0;
+  if (world_chunk(world, chunk->x - 1, chunk->z) != NULL) {
+    chunk->loaded_neighbors |= CHUNK_NEIGHBOR_X;
+  }
+  if (world_chunk(world, chunk->x, chunk->z - 1) != NULL) {
+    chunk->loaded_neighbors |= CHUNK_NEIGHBOR_Z;
+  }
+  Chunk *x_chunk = world_chunk(world, chunk->x + 1, chunk->z);
+  if (x_chunk != NULL) {
+    x_chunk->loaded_neighbors |= CHUNK_NEIGHBOR_X;
+  }
+  Chunk *z_chunk = world_chunk(world, chunk->x, chunk->z + 1);
+  if (z_chunk != NULL) {
+    z_chunk->loaded_neighbors |= CHUNK_NEIGHBOR_Z;
+  }
+}
+
+static void unlink_neighbors(World *world, int x, int z) {
+  Chunk *x_chunk = world_chunk(world, x + 1, z);
+  if (x_chunk != NULL) {
+    x_chunk->loaded_neighbors &= ~CHUNK_NEIGHBOR_X;
+  }
+  Chunk *z_chunk = world_chunk(world, x, z + 1);
+  if (z_chunk != NULL) {
+    z_chunk->loaded_neighbors &= ~CHUNK_NEIGHBOR_Z;
+  }
+}
+
+int world_add_chunk(World *world, Chunk *chunk) {
+  if (world->chunk_count == world->chunk_capacity) {
+    resize_chunks(world, round_capacity(world->chunk_capacity * 2, WORLD_MIN_CHUNKS));
+  }
+  uint32_t i = chunk_table_find(world, chunk->x, chunk->z);
+  if (world->chunk_table[i] != 0) {
+    int slot = world->chunk_table[i] - 1;
+    chunk_pool_release(world->chunk_pool, world->chunks[slot]);
+    world->chunks[slot] = chunk;
+    link_neighbors(world, chunk);
+    return slot;
+  }
+
+  // There's always a slot, the world grew above if every one was taken
+  int slot;
+  if (world->num_free_chunk_slots > 0) {
+    slot = world->free_chunk_slots[--world->num_free_chunk_slots];
+  } else {
+    slot = world->chunk_slots_used++;
+  }
+  world->chunks[slot] = chunk;
+  world->chunk_table[i] = slot + 1;
+  world->chunk_count++;
+  link_neighbors(world, chunk);
+  return slot;
+}
+
+static void load_paletted(PalettedContainer *c, int size, mcapiPalettedData *data) {
+  if (data->bits == 0) {
+    paletted_init(c, size, data->value);
+    return;
+  }
+  int palette[MCAPI_MAX_PALETTE_LEN];
+  mcapi_read_palette(data, palette);
+  paletted_load(c, size, data->bits, data->direct ? NULL : palette, data->palette_len, data->data);
+}
+
+Chunk *world_load_chunk(World *world, mcapiChunkAndLightDataPacket *packet) {
+  Chunk *chunk = world_chunk(world, packet->chunk_x, packet->chunk_z);
+  bool is_new = false;
+  if (chunk == NULL) {
+    chunk = chunk_pool_alloc(world->chunk_pool);
+    is_new = true;
+  } else {
+    // Reset chunk mesh
+    chunk_destroy_buffers(chunk);
+  }
 
-  FATAL("No space for chunk");
-  assert(false);
-  return -1;
+  chunk->x = packet->chunk_x;
+  chunk->z = packet->chunk_z;
+  for (int i = 0; i < Y_SECTIONS; i++) {
+    chunk->sections[i].num_quads = 0;
+    // The whole section is meshed again, so earlier edits don't need a patch
+    chunk->sections[i].dirty_groups = 0;
+    chunk->sections[i].x = packet->chunk_x;
+    chunk->sections[i].y = i - 4;
+    chunk->sections[i].z = packet->chunk_z;
+    load_paletted(&chunk->sections[i].blocks, 4096, &packet->chunk_sections[i].blocks);
+    load_paletted(&chunk->sections[i].biomes, 64, &packet->chunk_sections[i].biomes);
+    mcapi_copy_light(&packet->light, i + 1, chunk->sections[i].sky_light, chunk->sections[i].block_light);
+    chunk_section_count_blocks(&chunk->sections[i]);
+  }
+  if (is_new) {
+    world_add_chunk(world, chunk);
+  }
+  return chunk;
 }
 
 void world_destroy_chunk(World *world, int cx, int cz) {
-  for (int i = 0; i < MAX_CHUNKS; i += 1) {
-    if (world->chunks[i] != NULL && world->chunks[i]->x == cx && world->chunks[i]->z == cz) {
-      chunk_destroy(world->chunks[i]);
-      world->chunks[i] = NULL;
-    }
+  if (world->chunk_count == 0) {
+    return;
   }
+  uint32_t i = chunk_table_find(world, cx, cz);
+  if (world->chunk_table[i] == 0) {
+    return;
+  }
+  int slot = world->chunk_table[i] - 1;
+  chunk_table_remove(world, i);
+  chunk_pool_release(world->chunk_pool, world->chunks[slot]);
+  world->chunks[slot] = NULL;
+  world->free_chunk_slots[world->num_free_chunk_slots++] = slot;
+  world->chunk_count--;
+  unlink_neighbors(world, cx, cz);
+}
+
+BlockAccessor block_accessor_create(World *world) {
+  // No chunk can be at INT_MAX, so the first seek always looks one up
+  return (BlockAccessor){.world = world, .chunk_x = INT_MAX, .chunk_z = INT_MAX};
+}
+
+void block_accessor_seek(BlockAccessor *accessor, int x, int y, int z) {
+  int chunk_x = x >> 4;
+  int chunk_z = z >> 4;
+  if (chunk_x != accessor->chunk_x || chunk_z != accessor->chunk_z) {
+    accessor->chunk = world_chunk(accessor->world, chunk_x, chunk_z);
+    accessor->chunk_x = chunk_x;
+    accessor->chunk_z = chunk_z;
+  }
+  accessor->block[0] = x;
+  accessor->block[1] = y;
+  accessor->block[2] = z;
+  int s = (y >> 4) + 4;
+  if (accessor->chunk == NULL || s < 0 || s >= Y_SECTIONS) {
+    accessor->section = NULL;
+    return;
+  }
+  accessor->section = &accessor->chunk->sections[s];
+  accessor->index = (x & 15) + CHUNK_SIZE * ((z & 15) + CHUNK_SIZE * (y & 15));
+}
+
+void block_accessor_move(BlockAccessor *accessor, int dx, int dy, int dz) {
+  int x = (accessor->block[0] & 15) + dx;
+  int y = (accessor->block[1] & 15) + dy;
+  int z = (accessor->block[2] & 15) + dz;
+  // Staying in the section only moves the index
+  if (accessor->section != NULL && (unsigned)x < CHUNK_SIZE && (unsigned)y < CHUNK_SIZE && (unsigned)z < CHUNK_SIZE) {
+    accessor->block[0] += dx;
+    accessor->block[1] += dy;
+    accessor->block[2] += dz;
+    accessor->index += dx + CHUNK_SIZE * (dz + CHUNK_SIZE * dy);
+    return;
+  }
+  block_accessor_seek(accessor, accessor->block[0] + dx, accessor->block[1] + dy, accessor->block[2] + dz);
+}
+
+int block_accessor_at(BlockAccessor *accessor, vec3 position) {
+  block_accessor_seek(accessor, (int)floorf(position[0]), (int)floorf(position[1]), (int)floorf(position[2]));
+  return block_accessor_get(accessor);
 }
 
 int world_get_material(World *world, vec3 position) {
-  int chunk_x = (int)floor(position[0] / CHUNK_SIZE);
-  int chunk_z = (int)floor(position[2] / CHUNK_SIZE);
-  Chunk *chunk = world_chunk(world, chunk_x, chunk_z);
-  if (chunk == NULL) {
-    return 0;
+  BlockAccessor accessor = block_accessor_create(world);
+  return block_accessor_at(&accessor, position);
+}
+
+static uint32_t entity_hash(World *world, int id) {
+  uint32_t h = (uint32_t)id * 0x9E3779B1u;
+  return (h ^ (h >> 15)) & (2 * world->entity_capacity - 1);
+}
+
+// The table entry holding the entity with id, or the empty entry it would go in
+static uint32_t entity_table_find(World *world, int id) {
+  uint32_t i = entity_hash(world, id);
+  while (world->entity_table[i] != 0 && world->entities[world->entity_table[i] - 1]->id != id) {
+    i = (i + 1) & (2 * world->entity_capacity - 1);
   }
-  vec3 chunk_position;
-  glm_vec3_sub(position, (vec3){chunk->x * CHUNK_SIZE, 0.0f, chunk->z * CHUNK_SIZE}, chunk_position);
-  int x = (int)floor(chunk_position[0]);
-  int y = positive_mod((int)floor(chunk_position[1]), CHUNK_SIZE);
-  int z = (int)floor(chunk_position[2]);
-  int s = (int)floor(chunk_position[1] / CHUNK_SIZE) + 4;
-  return chunk->sections[s].data[x + CHUNK_SIZE * (z + CHUNK_SIZE * y)];
+  return i;
 }
 
-Entity *world_entity(World *world, int id) {
-  for (int i = 0; i < MAX_ENTITIES; i += 1) {
-    if (world->entities[i] == NULL) {
-      continue;
-    }
-    Entity *entity = world->entities[i];
-    if (entity->id == id) {
-      return entity;
+// Same as chunk_table_remove
+static void entity_table_remove(World *world, uint32_t i) {
+  uint32_t mask = 2 * world->entity_capacity - 1;
+  for (uint32_t j = (i + 1) & mask; world->entity_table[j] != 0; j = (j + 1) & mask) {
+    uint32_t home = entity_hash(world, world->entities[world->entity_table[j] - 1]->id);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      world->entity_table[i] = world->entity_table[j];
+      i = j;
     }
   }
-  return NULL;
+  world->entity_table[i] = 0;
 }
 
-int world_add_entity(World *world, Entity *entity) {
-  for (int i = 0; i < MAX_ENTITIES; i++) {
-    if (world->entities[i] != NULL && world->entities[i]->id == entity->id) {
-      entity_destroy(world->entities[i]);
-      world->entities[i] = entity;
-      entity->index = i;
-      return i;
+// Same as resize_chunks, the entities that move get their new index
+static void resize_entities(World *world, int capacity) {
+  Entity **entities = calloc(capacity, sizeof(Entity *));
+  int count = 0;
+  for (int i = 0; i < world->entity_slots_used; i++) {
+    if (world->entities[i] != NULL) {
+      entities[count] = world->entities[i];
+      entities[count]->index = count;
+      count++;
     }
   }
+  free(world->entities);
+  free(world->entity_table);
+  world->entities = entities;
+  world->entity_capacity = capacity;
+  world->entity_table = calloc(2 * capacity, sizeof(uint32_t));
+  world->entity_slots_used = count;
+  world->free_entity_slots = realloc(world->free_entity_slots, capacity * sizeof(int));
+  world->num_free_entity_slots = 0;
+  for (int slot = 0; slot < count; slot++) {
+    world->entity_table[entity_table_find(world, entities[slot]->id)] = slot + 1;
+  }
+}
 
-  for (int i = 0; i < MAX_ENTITIES; i += 1) {
-    if (world->entities[i] == NULL) {
-      world->entities[i] = entity;
-      entity->index = i;
-      world->entity_count++;
-      return i;
-    }
+Entity *world_entity(World *world, int id) {
+  if (world->entity_count == 0) {
+    return NULL;
+  }
+  uint32_t entry = world->entity_table[entity_table_find(world, id)];
+  return entry == 0 ? NULL : world->entities[entry - 1];
+}
+
+int world_add_entity(World *world, Entity *entity) {
+  if (world->entity_count == world->entity_capacity) {
+    resize_entities(world, round_capacity(world->entity_capacity * 2, WORLD_MIN_ENTITIES));
+  }
+  uint32_t i = entity_table_find(world, entity->id);
+  if (world->entity_table[i] != 0) {
+    int slot = world->entity_table[i] - 1;
+    entity_destroy(world->entities[slot]);
+    world->entities[slot] = entity;
+    entity->index = slot;
+    return slot;
   }
 
-  FATAL("No space for entity");
-  assert(false);
-  return -1;
+  int slot;
+  if (world->num_free_entity_slots > 0) {
+    slot = world->free_entity_slots[--world->num_free_entity_slots];
+  } else {
+    slot = world->entity_slots_used++;
+  }
+  world->entities[slot] = entity;
+  world->entity_table[i] = slot + 1;
+  entity->index = slot;
+  world->entity_count++;
+  return slot;
 }
 
 void world_destroy_entity(World *world, int id) {
-  for (int i = 0; i < MAX_ENTITIES; i++) {
-    if (world->entities[i] != NULL && world->entities[i]->id == id) {
+  if (world->entity_count == 0) {
+    return;
+  }
+  uint32_t i = entity_table_find(world, id);
+  if (world->entity_table[i] == 0) {
+    return;
+  }
+  int slot = world->entity_table[i] - 1;
+  entity_table_remove(world, i);
+  entity_destroy(world->entities[slot]);
+  world->entities[slot] = NULL;
+  world->free_entity_slots[world->num_free_entity_slots++] = slot;
+  world->entity_count--;
+  // Waiting until a quarter is used means adding and removing around a boundary doesn't resize every time
+  if (world->entity_capacity > WORLD_MIN_ENTITIES && world->entity_count <= world->entity_capacity / 4) {
+    resize_entities(world, world->entity_capacity / 2);
+  }
+}
+
+void world_destroy(World *world) {
+  for (int i = 0; i < world->chunk_slots_used; i++) {
+    if (world->chunks[i] != NULL) {
+      chunk_pool_release(world->chunk_pool, world->chunks[i]);
+    }
+  }
+  for (int i = 0; i < world->entity_slots_used; i++) {
+    if (world->entities[i] != NULL) {
       entity_destroy(world->entities[i]);
-      world->entities[i] = NULL;
-      world->entity_count--;
     }
   }
+  free(world->chunks);
+  free(world->chunk_table);
+  free(world->free_chunk_slots);
+  free(world->entities);
+  free(world->entity_table);
+  free(world->free_entity_slots);
+  free(world->dirty_sections);
+  free(world->pending_chunks);
+  ChunkPool *chunk_pool = world->chunk_pool;
+  *world = (World){.chunk_pool = chunk_pool};
 }
 
 void world_get_sky_color(World *world, vec3 position, BiomeInfo *biome_info, vec3 sky_color) {
-  int chunk_x = (int)floor(position[0] / CHUNK_SIZE);
-  int chunk_z = (int)floor(position[2] / CHUNK_SIZE);
-  Chunk *chunk = world_chunk(world, chunk_x, chunk_z);
-  if (chunk == NULL) {
+  BlockAccessor accessor = block_accessor_create(world);
+  block_accessor_at(&accessor, position);
+  if (accessor.section == NULL) {
     glm_vec3_copy((vec3){0.0f, 0.0f, 0.0f}, sky_color);
     return;
   }
-  vec3 chunk_position;
-  glm_vec3_sub(position, (vec3){chunk->x * CHUNK_SIZE, 0.0f, chunk->z * CHUNK_SIZE}, chunk_position);
-  int x = (int)floor(chunk_position[0]);
-  int y = positive_mod((int)floor(chunk_position[1]), CHUNK_SIZE);
-  int z = (int)floor(chunk_position[2]);
-  int s = (int)floor(chunk_position[1] / CHUNK_SIZE) + 4;
-  int biome_x = floor(x / 4.0);
-  int biome_z = floor(z / 4.0);
-  int biome_y = floor(y / 4.0);
-  int biome_index = chunk->sections[s].biome_data[biome_x + 4 * (biome_z + 4 * biome_y)];
+  int biome_x = (accessor.block[0] & 15) / 4;
+  int biome_y = (accessor.block[1] & 15) / 4;
+  int biome_z = (accessor.block[2] & 15) / 4;
+  int biome_index = paletted_get(&accessor.section->biomes, biome_x + 4 * (biome_z + 4 * biome_y));
   BiomeInfo biome = biome_info[biome_index];
   glm_vec3_copy(biome.sky_color, sky_color);
 }
 
-void world_set_block(World *world, vec3 position, int material, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device) {
-  int chunk_x = (int)floor(position[0] / CHUNK_SIZE);
-  int chunk_z = (int)floor(position[2] / CHUNK_SIZE);
-  Chunk *chunk = world_chunk(world, chunk_x, chunk_z);
-  if (chunk == NULL) {
+static_assert(MESH_GROUPS <= 64, "dirty_groups has a bit per mesh group");
+
+// Adds the groups to the section's dirty ones, queueing it if it wasn't dirty yet
+static void mark_section_dirty(World *world, ChunkSection *section, uint64_t groups) {
+  if (section->dirty_groups == 0) {
+    if (world->num_dirty_sections == world->dirty_sections_capacity) {
+      world->dirty_sections_capacity = world->dirty_sections_capacity > 0 ? world->dirty_sections_capacity * 2 : 64;
+      world->dirty_sections = realloc(world->dirty_sections, world->dirty_sections_capacity * sizeof(ivec3));
+    }
+    glm_ivec3_copy((ivec3){section->x, section->y, section->z}, world->dirty_sections[world->num_dirty_sections++]);
+  }
+  section->dirty_groups |= groups;
+}
+
+void world_set_block(World *world, vec3 position, int material) {
+  BlockAccessor accessor = block_accessor_create(world);
+  block_accessor_at(&accessor, position);
+  if (accessor.section == NULL) {
     return;
   }
-  vec3 chunk_position;
-  glm_vec3_sub(position, (vec3){chunk->x * CHUNK_SIZE, 0.0f, chunk->z * CHUNK_SIZE}, chunk_position);
-  int x = (int)floor(chunk_position[0]);
-  int y = positive_mod((int)floor(chunk_position[1]), CHUNK_SIZE);
-  int z = (int)floor(chunk_position[2]);
-  int s = (int)floor(chunk_position[1] / CHUNK_SIZE) + 4;
-  chunk->sections[s].data[x + CHUNK_SIZE * (z + CHUNK_SIZE * y)] = material;
+  Chunk *chunk = accessor.chunk;
+  int x = accessor.block[0] & 15;
+  int y = accessor.block[1] & 15;
+  int z = accessor.block[2] & 15;
+  int s = accessor.section - chunk->sections;
+  chunk_section_set_block(accessor.section, accessor.index, material);
 
-  // Update mesh
-  world_update_mesh_if_internal(world, &chunk->sections[s], block_info, biome_info, device);
+  // Only the slices on either side of the block and its layer of non-full blocks can change
+  uint64_t dirty = 1ull << LAYER_GROUP(y);
+  int p[3] = {x, y, z};
+  for (int d = 0; d < 3; d++) {
+    dirty |= 1ull << SLICE_GROUP(d, p[d]);
+    if (p[d] + 1 < CHUNK_SIZE) {
+      dirty |= 1ull << SLICE_GROUP(d, p[d] + 1);
+    }
+  }
+  mark_section_dirty(world, accessor.section, dirty);
 
-  // Update neighbors if at upper edge
+  // Update the first slice of neighbors if at upper edge
   if (x == CHUNK_SIZE - 1) {
     Chunk *chunk_x = world_chunk(world, chunk->x + 1, chunk->z);
     if (chunk_x) {
-      world_update_mesh_if_internal(world, &chunk_x->sections[s], block_info, biome_info, device);
+      mark_section_dirty(world, &chunk_x->sections[s], 1ull << SLICE_GROUP(0, 0));
     }
   }
   if (y == CHUNK_SIZE - 1 && s < Y_SECTIONS - 1) {
-    world_update_mesh_if_internal(world, &chunk->sections[s + 1], block_info, biome_info, device);
+    mark_section_dirty(world, &chunk->sections[s + 1], 1ull << SLICE_GROUP(1, 0));
   }
   if (z == CHUNK_SIZE - 1) {
     Chunk *chunk_z = world_chunk(world, chunk->x, chunk->z + 1);
     if (chunk_z) {
-      world_update_mesh_if_internal(world, &chunk_z->sections[s], block_info, biome_info, device);
+      mark_section_dirty(world, &chunk_z->sections[s], 1ull << SLICE_GROUP(2, 0));
     }
   }
 }
 
-void world_target_block(World *world, vec3 position, vec3 look, float reach, vec3 target, vec3 normal, int *material) {
-  int chunk_x = (int)floor(position[0] / CHUNK_SIZE);
-  int chunk_z = (int)floor(position[2] / CHUNK_SIZE);
-  Chunk *chunk = world_chunk(world, chunk_x, chunk_z);
-  if (chunk == NULL) {
-    *material = 0;
-    return;
+// The accessor is shared between the rays of a batch, so rays close together don't each look up their chunks
+static bool raycast(BlockAccessor *accessor, vec3 origin, vec3 direction, float max_distance, WorldRayHit *hit) {
+  *hit = (WorldRayHit){0};
+  vec3 dir;
+  glm_vec3_normalize_to(direction, dir);
+  int block[3];
+  int step[3];
+  float t_max[3]; // Distance along the ray to the next voxel boundary on each axis
+  float t_delta[3]; // Distance between boundaries on each axis, always positive
+  for (int d = 0; d < 3; d++) {
+    block[d] = (int)floorf(origin[d]);
+    if (dir[d] > 0) {
+      step[d] = 1;
+      t_delta[d] = 1.0f / dir[d];
+      t_max[d] = (block[d] + 1 - origin[d]) * t_delta[d];
+    } else if (dir[d] < 0) {
+      step[d] = -1;
+      t_delta[d] = -1.0f / dir[d];
+      t_max[d] = (origin[d] - block[d]) * t_delta[d];
+    } else {
+      step[d] = 0;
+      t_delta[d] = INFINITY;
+      t_max[d] = INFINITY;
+    }
   }
-  float distance = 0.0f;
-  vec3 location;
-  glm_vec3_copy(position, location);
-  vec3 delta;
-  glm_vec3_scale(look, 0.01f, delta);
-  while (distance < reach) {
-    int chunk_x = (int)floor(location[0] / CHUNK_SIZE);
-    int chunk_z = (int)floor(location[2] / CHUNK_SIZE);
-    if (chunk->x != chunk_x || chunk->z != chunk_z) {
-      chunk = world_chunk(world, chunk_x, chunk_z);
-      if (chunk == NULL) {
-        *material = 0;
-        return;
-      }
+
+  float t = 0.0f;
+  int entered = -1; // The axis the ray crossed to get into the current voxel
+  block_accessor_seek(accessor, block[0], block[1], block[2]);
+  while (true) {
+    // Nothing past the loaded area can be hit
+    if (accessor->chunk == NULL) {
+      return false;
     }
-    vec3 chunk_location;
-    glm_vec3_sub(location, (vec3){chunk->x * CHUNK_SIZE, 0.0f, chunk->z * CHUNK_SIZE}, chunk_location);
-    int x = (int)floor(chunk_location[0]);
-    int y = positive_mod((int)floor(chunk_location[1]), CHUNK_SIZE);
-    int z = (int)floor(chunk_location[2]);
-    int section = (int)floor(chunk_location[1] / CHUNK_SIZE) + 4;
-    int mat = chunk->sections[section].data[x + CHUNK_SIZE * (z + CHUNK_SIZE * y)];
-    if (mat != 0) {
-      glm_vec3_copy(location, target);
-      glm_vec3_copy((vec3){0.0f, 0.0f, 0.0f}, normal);
-      vec3 low_dist;
-      glm_vec3_sub(location, (vec3){floor(location[0]), floor(location[1]), floor(location[2])}, low_dist);
-      vec3 high_dist;
-      glm_vec3_sub((vec3){ceil(location[0]), ceil(location[1]), ceil(location[2])}, location, high_dist);
-      int min_x_dir = low_dist[0] < high_dist[0] ? -1 : 1;
-      float min_x = low_dist[0] < high_dist[0] ? low_dist[0] : high_dist[0];
-      int min_y_dir = low_dist[1] < high_dist[1] ? -1 : 1;
-      float min_y = low_dist[1] < high_dist[1] ? low_dist[1] : high_dist[1];
-      int min_z_dir = low_dist[2] < high_dist[2] ? -1 : 1;
-      float min_z = low_dist[2] < high_dist[2] ? low_dist[2] : high_dist[2];
-      if (min_x < min_y && min_x < min_z) {
-        normal[0] = min_x_dir;
-      } else if (min_y < min_z) {
-        normal[1] = min_y_dir;
-      } else {
-        normal[2] = min_z_dir;
+    if (accessor->section != NULL) {
+      int material = accessor->section->non_air_count > 0 ? block_accessor_get(accessor) : 0;
+      if (material != 0) {
+        hit->material = material;
+        glm_ivec3_copy(block, hit->block);
+        if (entered >= 0) {
+          hit->normal[entered] = -step[entered];
+        }
+        hit->distance = t;
+        glm_vec3_muladds(dir, t, hit->position);
+        glm_vec3_add(hit->position, origin, hit->position);
+        return true;
       }
-      *material = mat;
-      return;
+    } else if (block[1] < 0 ? step[1] <= 0 : step[1] >= 0) {
+      // Above or below the world and heading away from it
+      return false;
+    }
+
+    entered = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+    t = t_max[entered];
+    if (t > max_distance) {
+      return false;
     }
-    distance += 0.01f;
-    glm_vec3_add(location, delta, location);
+    block[entered] += step[entered];
+    block_accessor_move(accessor, entered == 0 ? step[0] : 0, entered == 1 ? step[1] : 0, entered == 2 ? step[2] : 0);
+    // Measured from the origin rather than added up, so long rays don't drift off the grid
+    t_max[entered] = (block[entered] + (step[entered] > 0) - origin[entered]) * t_delta[entered] * step[entered];
+  }
+}
+
+bool world_raycast(World *world, vec3 origin, vec3 direction, float max_distance, WorldRayHit *hit) {
+  BlockAccessor accessor = block_accessor_create(world);
+  return raycast(&accessor, origin, direction, max_distance, hit);
+}
+
+int world_raycast_batch(World *world, int count, vec3 *origins, vec3 *directions, float *max_distances, WorldRayHit *hits) {
+  BlockAccessor accessor = block_accessor_create(world);
+  int num_hits = 0;
+  for (int i = 0; i < count; i++) {
+    num_hits += raycast(&accessor, origins[i], directions[i], max_distances[i], &hits[i]);
   }
-  *material = 0;
+  return num_hits;
 }
 
-void world_init_new_meshes(World *world, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device) {
-  for (int ci = 0; ci < MAX_CHUNKS; ci += 1) {
-    Chunk *chunk = world->chunks[ci];
-    if (chunk == NULL) {
+void world_target_block(World *world, vec3 position, vec3 look, float reach, vec3 target, vec3 normal, int *material) {
+  WorldRayHit hit;
+  world_raycast(world, position, look, reach, &hit);
+  glm_vec3_copy((vec3){hit.block[0], hit.block[1], hit.block[2]}, target);
+  glm_vec3_copy((vec3){hit.normal[0], hit.normal[1], hit.normal[2]}, normal);
+  *material = hit.material;
+}
+
+static void world_submit_chunk(World *world, MeshPool *mesh_pool, Chunk *chunk, bool only_new) {
+  if (chunk == NULL || chunk->loaded_neighbors != CHUNK_NEIGHBORS_READY) {
+    return;
+  }
+  Chunk *x_chunk = world_chunk(world, chunk->x - 1, chunk->z);
+  Chunk *z_chunk = world_chunk(world, chunk->x, chunk->z - 1);
+  for (int s = 0; s < 24; s += 1) {
+    if (only_new && (chunk->sections[s].has_mesh || chunk->sections[s].mesh_job != 0)) {
       continue;
     }
-    Chunk *x_chunk = world_chunk(world, chunk->x - 1, chunk->z);
-    Chunk *z_chunk = world_chunk(world, chunk->x, chunk->z - 1);
-    if (x_chunk == NULL || z_chunk == NULL) {
+    ChunkSection *neighbors[3] = {NULL, NULL, NULL};
+    neighbors[0] = &x_chunk->sections[s];
+    neighbors[2] = &z_chunk->sections[s];
+    if (s > 0) {
+      neighbors[1] = &chunk->sections[s - 1];
+    }
+    mesh_pool_submit(mesh_pool, &chunk->sections[s], neighbors);
+  }
+}
+
+void world_init_chunk_meshes(World *world, MeshPool *mesh_pool, Chunk *chunk) {
+  world_submit_chunk(world, mesh_pool, chunk, true);
+  // The chunk may have been the last neighbor these were waiting for
+  world_submit_chunk(world, mesh_pool, world_chunk(world, chunk->x + 1, chunk->z), true);
+  world_submit_chunk(world, mesh_pool, world_chunk(world, chunk->x, chunk->z + 1), true);
+}
+
+void world_queue_chunk_meshes(World *world, Chunk *chunk) {
+  if (chunk->mesh_queued) {
+    return;
+  }
+  if (world->num_pending_chunks == world->pending_chunks_capacity) {
+    world->pending_chunks_capacity = world->pending_chunks_capacity > 0 ? world->pending_chunks_capacity * 2 : 64;
+    world->pending_chunks = realloc(world->pending_chunks, world->pending_chunks_capacity * sizeof(ivec2));
+  }
+  world->pending_chunks[world->num_pending_chunks][0] = chunk->x;
+  world->pending_chunks[world->num_pending_chunks][1] = chunk->z;
+  world->num_pending_chunks++;
+  chunk->mesh_queued = true;
+}
+
+static double now_seconds() {
+  struct timespec t;
+  timespec_get(&t, TIME_UTC);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int world_process_dirty(World *world, MeshPool *mesh_pool, BlockInfo *block_info, double budget) {
+  double start = now_seconds();
+  int done = 0;
+  int sections = 0;
+  int chunks = 0;
+  // Edits go first, they're quick to patch and usually the player's own
+  while (sections < world->num_dirty_sections || chunks < world->num_pending_chunks) {
+    if (done > 0 && now_seconds() - start >= budget) {
+      break;
+    }
+    done++;
+    if (sections < world->num_dirty_sections) {
+      int *p = world->dirty_sections[sections++];
+      Chunk *chunk = world_chunk(world, p[0], p[2]);
+      if (chunk == NULL || chunk->sections[p[1] + 4].dirty_groups == 0) {
+        continue;
+      }
+      ChunkSection *section = &chunk->sections[p[1] + 4];
+      bool dirty[MESH_GROUPS];
+      for (int g = 0; g < MESH_GROUPS; g++) {
+        dirty[g] = (section->dirty_groups >> g) & 1;
+      }
+      section->dirty_groups = 0;
+      world_patch_mesh_if_internal(world, section, block_info, dirty);
+    } else {
+      int *p = world->pending_chunks[chunks++];
+      Chunk *chunk = world_chunk(world, p[0], p[1]);
+      if (chunk == NULL || !chunk->mesh_queued) {
+        continue;
+      }
+      chunk->mesh_queued = false;
+      world_init_chunk_meshes(world, mesh_pool, chunk);
+    }
+  }
+
+  // Move what's left to the front for next time
+  if (sections > 0) {
+    world->num_dirty_sections -= sections;
+    memmove(world->dirty_sections, world->dirty_sections + sections, world->num_dirty_sections * sizeof(ivec3));
+  }
+  if (chunks > 0) {
+    world->num_pending_chunks -= chunks;
+    memmove(world->pending_chunks, world->pending_chunks + chunks, world->num_pending_chunks * sizeof(ivec2));
+  }
+  return done;
+}
+
+// Queues every meshable section again, the old buffers stay until the new ones are uploaded
+void world_remesh_all(World *world, MeshPool *mesh_pool) {
+  for (int i = 0; i < world->chunk_slots_used; i++) {
+    world_submit_chunk(world, mesh_pool, world->chunks[i], false);
+  }
+}
+
+int world_compact_meshes(World *world, QuadArena *arena, double budget) {
+  if (!quad_arena_fragmented(arena)) {
+    return 0;
+  }
+  // Trimming only releases pages at the end, so drain the last one into the room before it
+  double start = now_seconds();
+  int last = arena->num_pages - 1;
+  int moved = 0;
+  for (int i = 0; i < world->chunk_slots_used; i++) {
+    if (world->chunks[i] == NULL) {
       continue;
     }
-    for (int s = 0; s < 24; s += 1) {
-      if (chunk->sections[s].vertex_buffer != NULL) {
+    for (int s = 0; s < Y_SECTIONS; s++) {
+      ChunkSection *section = &world->chunks[i]->sections[s];
+      if (section->quad_range.size == 0 || section->quad_range.page != last) {
         continue;
       }
-      ChunkSection *neighbors[3] = {NULL, NULL, NULL};
-      neighbors[0] = &x_chunk->sections[s];
-      neighbors[2] = &z_chunk->sections[s];
-      if (s > 0) {
-        neighbors[1] = &chunk->sections[s - 1];
+      if (moved > 0 && now_seconds() - start >= budget) {
+        return moved;
+      }
+      if (!chunk_section_move_quads(section)) {
+        return moved;
+      }
+      moved++;
+    }
+  }
+  quad_arena_trim(arena);
+  return moved;
+}
+
+// Uploads the meshes the workers have finished, returns how many were used
+int world_upload_finished_meshes(World *world, MeshPool *mesh_pool) {
+  int uploaded = 0;
+  MeshResult *result = mesh_pool_take_results(mesh_pool);
+  while (result != NULL) {
+    MeshResult *next = result->next;
+    Chunk *chunk = world_chunk(world, result->x, result->z);
+    // Drop results for chunks that were unloaded or sections that changed since the job was queued
+    if (chunk != NULL) {
+      ChunkSection *section = &chunk->sections[result->y + 4];
+      if (section->mesh_job == result->job) {
+        chunk_section_upload_mesh(section, &result->mesh);
+        section->mesh_job = 0;
+        uploaded++;
       }
-      chunk_section_update_mesh(&chunk->sections[s], neighbors, block_info, biome_info, device);
     }
+    mesh_result_destroy(result);
+    result = next;
   }
+  return uploaded;
 }
 
-void world_update_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device) {
+// Finds the -x, -y and -z neighbors of a section, returns false if the chunks they're in aren't loaded
+static bool world_section_neighbors(World *world, ChunkSection *section, ChunkSection *neighbors[3]) {
   Chunk *chunk = world_chunk(world, section->x, section->z);
   Chunk *x_chunk = world_chunk(world, section->x - 1, section->z);
   Chunk *z_chunk = world_chunk(world, section->x, section->z - 1);
   if (chunk == NULL || x_chunk == NULL || z_chunk == NULL) {
-    return;
+    return false;
   }
   int s = section->y + 4;
-  ChunkSection *neighbors[3] = {&x_chunk->sections[s], NULL, &z_chunk->sections[s]};
-  if (s > 0) {
-    neighbors[1] = &chunk->sections[s - 1];
+  neighbors[0] = &x_chunk->sections[s];
+  neighbors[1] = s > 0 ? &chunk->sections[s - 1] : NULL;
+  neighbors[2] = &z_chunk->sections[s];
+  return true;
+}
+
+void world_update_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info) {
+  ChunkSection *neighbors[3];
+  if (world_section_neighbors(world, section, neighbors)) {
+    chunk_section_update_mesh(section, neighbors, block_info);
+  }
+}
+
+void world_patch_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info, bool dirty[MESH_GROUPS]) {
+  ChunkSection *neighbors[3];
+  if (world_section_neighbors(world, section, neighbors)) {
+    chunk_section_patch_mesh(section, neighbors, block_info, dirty);
   }
-  chunk_section_update_mesh(&chunk->sections[s], neighbors, block_info, biome_info, device);
 }
@@ -2,26 +2,129 @@
 #include <cglm/cglm.h>
 
 #include "chunk.h"
+#include "chunk_pool.h"
 #include "entity.h"
+#include "mesh_pool.h"
+#include "mcapi/chunk.h"
 
-#define MAX_CHUNKS 1024
-#define MAX_ENTITIES 1024
+// The fewest slots the world shrinks to, capacities are always powers of two
+#define WORLD_MIN_CHUNKS 64
+#define WORLD_MIN_ENTITIES 64
 
+typedef struct WorldRayHit {
+  int material; // 0 when nothing was hit
+  ivec3 block;
+  ivec3 normal; // Of the face the ray entered through, zero when it started inside the block
+  float distance; // In blocks from the origin
+  vec3 position; // Where the ray entered the block
+} WorldRayHit;
+
+// A zeroed world is empty, the slots and tables are allocated as chunks and entities arrive
 typedef struct World {
-  Chunk *chunks[MAX_CHUNKS];
+  ChunkPool *chunk_pool; // Every chunk in the world comes from here
+  Chunk **chunks; // chunk_capacity slots
+  int chunk_capacity;
+  int chunk_count;
+  // Open addressing index from chunk position to slot in chunks, entries are slot + 1 and 0 when
+  // empty. It has twice as many entries as there are slots, which keeps the probe sequences short.
+  uint32_t *chunk_table;
+  int chunk_slots_used; // Slots from here on have never held a chunk
+  int *free_chunk_slots; // Slots below chunk_slots_used whose chunk was destroyed
+  int num_free_chunk_slots;
+  Entity **entities; // entity_capacity slots, an entity's index is its slot
+  int entity_capacity;
   int entity_count;
-  Entity *entities[MAX_ENTITIES];
+  // Index from network id to slot in entities, laid out like chunk_table
+  uint32_t *entity_table;
+  int entity_slots_used;
+  int *free_entity_slots;
+  int num_free_entity_slots;
+  // Work for world_process_dirty, by position since the chunks can be unloaded before it's done.
+  // A chunk or section is only added once until it's processed.
+  ivec3 *dirty_sections;
+  int num_dirty_sections;
+  int dirty_sections_capacity;
+  ivec2 *pending_chunks; // Chunks to queue for meshing once their neighbors are there
+  int num_pending_chunks;
+  int pending_chunks_capacity;
 } World;
 
+// Reads the blocks around a position, keeping the chunk and section it's in so reads close by
+// skip the floor math and chunk lookup. Only valid until chunks are loaded or unloaded.
+typedef struct BlockAccessor {
+  World *world;
+  Chunk *chunk; // NULL when the chunk at chunk_x, chunk_z isn't loaded
+  int chunk_x;
+  int chunk_z;
+  ChunkSection *section; // NULL when there's no chunk or the block is above or below the world
+  ivec3 block;
+  int index; // Of the block in section
+} BlockAccessor;
+
 Chunk *world_chunk(World *world, int x, int z);
+
+BlockAccessor block_accessor_create(World *world);
+void block_accessor_seek(BlockAccessor *accessor, int x, int y, int z);
+// Moves by a few blocks, usually without leaving the section
+void block_accessor_move(BlockAccessor *accessor, int dx, int dy, int dz);
+// Seeks to the block position is in and returns it
+int block_accessor_at(BlockAccessor *accessor, vec3 position);
+
+// The block state, 0 (air) outside the loaded world
+static inline int block_accessor_get(BlockAccessor *accessor) {
+  return accessor->section != NULL ? chunk_section_get_block(accessor->section, accessor->index) : 0;
+}
+
+// Full sky light above the world, none below it or in unloaded chunks
+static inline int block_accessor_sky_light(BlockAccessor *accessor) {
+  if (accessor->section == NULL) {
+    return accessor->chunk != NULL && accessor->block[1] >= (Y_SECTIONS - 4) * CHUNK_SIZE ? 15 : 0;
+  }
+  return light_get(accessor->section->sky_light, accessor->index);
+}
+
+static inline int block_accessor_block_light(BlockAccessor *accessor) {
+  return accessor->section != NULL ? light_get(accessor->section->block_light, accessor->index) : 0;
+}
+
+// chunk must come from the world's chunk pool, it's released when replaced or destroyed
 int world_add_chunk(World *world, Chunk *chunk);
+// Sizes the chunk slots for count chunks, moving the loaded ones to the lowest slots. The world
+// grows past it by itself, this just avoids growing in steps or keeping slots it doesn't need.
+void world_reserve_chunks(World *world, int count);
+// Creates the chunk a chunk data packet describes, or replaces the blocks and light of the loaded one
+Chunk *world_load_chunk(World *world, mcapiChunkAndLightDataPacket *packet);
 void world_destroy_chunk(World *world, int cx, int cz);
 int world_get_material(World *world, vec3 position);
 Entity *world_entity(World *world, int id);
 int world_add_entity(World *world, Entity *entity);
+// Shrinks the entity slots when few are used, which moves entities and changes their index
 void world_destroy_entity(World *world, int id);
+// Releases every chunk and entity, and frees the slots and tables
+void world_destroy(World *world);
 void world_get_sky_color(World *world, vec3 position, BiomeInfo *biome_info, vec3 sky_color);
-void world_set_block(World *world, vec3 position, int material, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device);
+// Marks the mesh groups the block touches dirty, the meshes are patched by world_process_dirty
+void world_set_block(World *world, vec3 position, int material);
+// Walks the voxels along the ray one at a time, stopping at the first block that isn't air within
+// max_distance. Unloaded chunks end the ray as a miss. hit is zeroed when nothing is hit.
+bool world_raycast(World *world, vec3 origin, vec3 direction, float max_distance, WorldRayHit *hit);
+// Casts count rays, reusing chunk lookups between them, returns how many hit something
+int world_raycast_batch(World *world, int count, vec3 *origins, vec3 *directions, float *max_distances, WorldRayHit *hits);
+// The block the player is looking at, target is its lowest corner and material is 0 when there's none
 void world_target_block(World *world, vec3 position, vec3 look, float reach, vec3 target, vec3 normal, int *material);
-void world_init_new_meshes(World *world, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device);
-void world_update_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info, BiomeInfo *biome_info, WGPUDevice device);
+// Queues the sections without a mesh of a chunk that just arrived or changed, and of the +x and +z
+// chunks that may have been waiting for it. Chunks are only meshed once their -x and -z neighbors are loaded.
+void world_init_chunk_meshes(World *world, MeshPool *mesh_pool, Chunk *chunk);
+// Leaves world_init_chunk_meshes for world_process_dirty, so a burst of chunk packets doesn't stall a frame
+void world_queue_chunk_meshes(World *world, Chunk *chunk);
+// Patches the meshes of edited sections and meshes the pending chunks, oldest first, until budget
+// seconds have passed. Always does at least one, returns how many were done.
+int world_process_dirty(World *world, MeshPool *mesh_pool, BlockInfo *block_info, double budget);
+void world_remesh_all(World *world, MeshPool *mesh_pool);
+int world_upload_finished_meshes(World *world, MeshPool *mesh_pool);
+// When the arena is fragmented, moves sections off its last page into earlier ones from
+// their retained quads until budget seconds pass, and releases the page once it's empty.
+// Returns how many sections were moved.
+int world_compact_meshes(World *world, QuadArena *arena, double budget);
+void world_update_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info);
+void world_patch_mesh_if_internal(World *world, ChunkSection *section, BlockInfo *block_info, bool dirty[MESH_GROUPS]);